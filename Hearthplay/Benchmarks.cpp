@@ -0,0 +1,419 @@
+#include "Benchmarks.h"
+#include "GameState.h"
+#include "Cards.h"
+#include "MCTS.h"
+#include "Clock.h"
+#include "Random.h"
+#include "UCT.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <new>
+#include <random>
+#include <thread>
+
+GameState SetupGame(const Card(&deck)[30], Random& r); // Main.cpp
+
+// Benchmarks always play from the same positions so runs can be compared
+static const uint32_t BenchmarkSeed = 1234;
+
+static double SecondsSince(HighResClock::time_point start)
+{
+	return std::chrono::duration<double>(HighResClock::now( ) - start).count( );
+}
+
+static void RandomDeck(Card(&deck)[30], Random& r)
+{
+	for (Card& c : deck)
+	{
+		c = DeckPossibleCards[RandomBelow(r, (uint32_t)DeckPossibleCards.size( ))];
+	}
+}
+
+// A game a few turns in, so there are minions on the board and a reasonable number of moves
+static GameState MidgameState(Random& r)
+{
+	Card deck[30];
+	for (;;)
+	{
+		RandomDeck(deck, r);
+		GameState game = SetupGame(deck, r);
+
+		uint32_t turns = 0;
+		while (game.m_winner == Winner::Undetermined && turns < 8)
+		{
+			Move m = game.m_possible_moves[RandomBelow(r, game.m_possible_moves.Num( ))];
+			if (m.m_type == MoveType::EndTurn)
+			{
+				++turns;
+			}
+			game.ProcessMove(m);
+		}
+
+		if (game.m_winner == Winner::Undetermined)
+		{
+			return game;
+		}
+	}
+}
+
+template<typename RandomType>
+static double PlayoutsPerSecond(const GameState& game, unsigned playouts, RandomType& r)
+{
+	auto start = HighResClock::now( );
+	for (unsigned i = 0; i < playouts; ++i)
+	{
+		GameStateCore playout_state(game);
+		playout_state.PlayOutRandomly(r);
+	}
+	return playouts / SecondsSince(start);
+}
+
+// ProcessMove as it was before only the changed parts of the move list were regenerated
+struct FullRebuildGameState : public GameState
+{
+	FullRebuildGameState(const GameState& game)
+		: GameState(game)
+	{
+	}
+
+	void ProcessMove(const Move& m)
+	{
+		GameStateCore::ProcessMove(m, nullptr);
+		GeneratePossibleMoves( );
+	}
+};
+
+// Nanoseconds per ProcessMove playing games out from the list of possible moves
+template<typename StateType>
+static double NanosecondsPerMove(const GameState& game, unsigned games, Random& r)
+{
+	uint32_t moves = 0;
+	auto start = HighResClock::now( );
+	for (unsigned i = 0; i < games; ++i)
+	{
+		StateType state(game);
+		state.m_skip_hashing = true;
+		while (state.m_winner == Winner::Undetermined)
+		{
+			state.ProcessMove(state.m_possible_moves[RandomBelow(r, state.m_possible_moves.Num( ))]);
+			++moves;
+		}
+	}
+	return SecondsSince(start) * 1e9 / moves;
+}
+
+typedef void(*BenchmarkFunc)();
+
+struct Benchmark
+{
+	const char*		m_name;
+	BenchmarkFunc	m_func;
+};
+
+Benchmark Benchmarks[] =
+{
+	{
+		"DeterminizedMCTS root parallel move latency (32 determinizations x 100 iterations)", []( )
+		{
+			const unsigned num_moves = 10;
+			const unsigned max_threads = std::max(1u, std::thread::hardware_concurrency( ));
+
+			Random r(BenchmarkSeed);
+			GameState game = MidgameState(r);
+
+			double single_thread_ms = 0.0;
+			for (unsigned threads = 1; ; threads = std::min(threads * 2, max_threads))
+			{
+				auto start = HighResClock::now( );
+				for (unsigned i = 0; i < num_moves; ++i)
+				{
+					DeterminizedMCTS::ChooseMove(game, 32, 100, threads, BenchmarkSeed);
+				}
+				double ms = SecondsSince(start) * 1000.0 / num_moves;
+				if (threads == 1)
+				{
+					single_thread_ms = ms;
+				}
+
+				printf("  %2u threads: %8.2f ms/move, %5.2fx\n", threads, ms, single_thread_ms / ms);
+
+				if (threads == max_threads)
+					break;
+			}
+		}
+	},
+	{
+		"SO-IS-MCTS tree parallel iterations per second (4000 iterations)", []( )
+		{
+			const unsigned num_moves = 5;
+			const unsigned iterations = 4000;
+			const unsigned max_threads = std::max(1u, std::thread::hardware_concurrency( ));
+
+			Random r(BenchmarkSeed);
+			GameState game = MidgameState(r);
+
+			auto start = HighResClock::now( );
+			for (unsigned i = 0; i < num_moves; ++i)
+			{
+				SO_IS_MCTS::ChooseMove(game, iterations, BenchmarkSeed);
+			}
+			double single_rate = num_moves * iterations / SecondsSince(start);
+			printf("  sequential: %10.0f iterations/s\n", single_rate);
+
+			for (unsigned threads = 1; ; threads = std::min(threads * 2, max_threads))
+			{
+				start = HighResClock::now( );
+				for (unsigned i = 0; i < num_moves; ++i)
+				{
+					SO_IS_MCTS::ChooseMove(game, iterations, threads, BenchmarkSeed);
+				}
+				double rate = num_moves * iterations / SecondsSince(start);
+				printf("  %2u threads: %10.0f iterations/s, %5.2fx\n", threads, rate, rate / single_rate);
+
+				if (threads == max_threads)
+					break;
+			}
+		}
+	},
+	{
+		"Copying vs undo journal per iteration (10000 iterations, 4 move descent then playout)", []( )
+		{
+			const unsigned iterations = 10000;
+			const unsigned descent = 4;
+
+			Random r(BenchmarkSeed);
+			const GameState game = MidgameState(r);
+			UndoJournal journal;
+
+			auto descend = [&](GameState& state, UndoJournal* descent_journal)
+			{
+				for (unsigned i = 0; i < descent && state.m_winner == Winner::Undetermined; ++i)
+				{
+					state.ProcessMove(state.m_possible_moves[RandomBelow(r, state.m_possible_moves.Num( ))], descent_journal);
+				}
+			};
+
+			// Every variant plays exactly the same games
+			r.Seed(BenchmarkSeed);
+			auto start = HighResClock::now( );
+			for (unsigned i = 0; i < iterations; ++i)
+			{
+				GameState sim_state(game);
+				descend(sim_state, nullptr);
+				sim_state.PlayOutRandomly(r);
+			}
+			double copy_rate = iterations / SecondsSince(start);
+			printf("  copy per iteration:         %10.0f iterations/s\n", copy_rate);
+
+			GameState sim_state(game);
+			r.Seed(BenchmarkSeed);
+			start = HighResClock::now( );
+			for (unsigned i = 0; i < iterations; ++i)
+			{
+				UndoJournal::Mark mark = journal.GetMark( );
+				descend(sim_state, &journal);
+				GameStateCore playout_state(sim_state);
+				playout_state.PlayOutRandomly(r);
+				journal.RollBack(mark);
+			}
+			double descent_rate = iterations / SecondsSince(start);
+			printf("  journaled descent, copy:    %10.0f iterations/s, %5.2fx\n", descent_rate, descent_rate / copy_rate);
+
+			r.Seed(BenchmarkSeed);
+			start = HighResClock::now( );
+			for (unsigned i = 0; i < iterations; ++i)
+			{
+				UndoJournal::Mark mark = journal.GetMark( );
+				descend(sim_state, &journal);
+				sim_state.PlayOutRandomly(r, &journal);
+				journal.RollBack(mark);
+			}
+			double journal_rate = iterations / SecondsSince(start);
+			printf("  journaled descent, playout: %10.0f iterations/s, %5.2fx\n", journal_rate, journal_rate / copy_rate);
+		}
+	},
+	{
+		"Game state copies per second (1000000 copies)", []( )
+		{
+			const unsigned copies = 1000000;
+			const unsigned ring_size = 16;
+
+			Random r(BenchmarkSeed);
+			const GameState game = MidgameState(r);
+
+			// Copy round a ring of states and read each copy back, so the copies can't be optimized away
+			static GameState full_states[ring_size];
+			static GameStateCore core_states[ring_size];
+			uint32_t checksum = 0;
+
+			auto start = HighResClock::now( );
+			for (unsigned i = 0; i < copies; ++i)
+			{
+				GameState* copy = new (&full_states[i % ring_size]) GameState(game);
+				checksum += copy->m_players[i & 1].m_health;
+			}
+			double full_rate = copies / SecondsSince(start);
+			printf("  GameState     (%4u bytes): %12.0f copies/s\n", (unsigned)sizeof(GameState), full_rate);
+
+			start = HighResClock::now( );
+			for (unsigned i = 0; i < copies; ++i)
+			{
+				GameStateCore* copy = new (&core_states[i % ring_size]) GameStateCore(game);
+				checksum += copy->m_players[i & 1].m_health;
+			}
+			double core_rate = copies / SecondsSince(start);
+			printf("  GameStateCore (%4u bytes): %12.0f copies/s, %5.2fx\n", (unsigned)sizeof(GameStateCore), core_rate, core_rate / full_rate);
+
+			if (checksum == 0)
+			{
+				printf("  (checksum %u)\n", checksum);
+			}
+		}
+	},
+	{
+		"Playouts per second picking from the move list or counted moves (10000 playouts from a midgame state)", []( )
+		{
+			const unsigned playouts = 10000;
+
+			Random r(BenchmarkSeed);
+			const GameState game = MidgameState(r);
+
+			// How PlayOutRandomly used to play, building every legal move after each one
+			auto start = HighResClock::now( );
+			for (unsigned i = 0; i < playouts; ++i)
+			{
+				GameState playout_state(game);
+				playout_state.m_skip_hashing = true;
+				while (playout_state.m_winner == Winner::Undetermined)
+				{
+					playout_state.ProcessMove(playout_state.m_possible_moves[RandomBelow(r, playout_state.m_possible_moves.Num( ))]);
+				}
+			}
+			double list_rate = playouts / SecondsSince(start);
+			printf("  move list:     %10.0f playouts/s\n", list_rate);
+
+			double counted_rate = PlayoutsPerSecond(game, playouts, r);
+			printf("  counted moves: %10.0f playouts/s, %5.2fx\n", counted_rate, counted_rate / list_rate);
+		}
+	},
+	{
+		"ProcessMove cost rebuilding the whole move list or only what changed (5000 games from a midgame state)", []( )
+		{
+			const unsigned games = 5000;
+
+			Random r(BenchmarkSeed);
+			const GameState game = MidgameState(r);
+
+			// Both play exactly the same games, as the move lists are the same
+			r.Seed(BenchmarkSeed);
+			double full_ns = NanosecondsPerMove<FullRebuildGameState>(game, games, r);
+			printf("  full rebuild:  %8.1f ns/move\n", full_ns);
+
+			r.Seed(BenchmarkSeed);
+			double refresh_ns = NanosecondsPerMove<GameState>(game, games, r);
+			printf("  only changes:  %8.1f ns/move, %5.2fx\n", refresh_ns, full_ns / refresh_ns);
+		}
+	},
+	{
+		"Playouts per second by random number generator (10000 playouts from a midgame state)", []( )
+		{
+			const unsigned playouts = 10000;
+
+			Random setup_random(BenchmarkSeed);
+			const GameState game = MidgameState(setup_random);
+
+			std::mt19937 mt(BenchmarkSeed);
+			Pcg32 pcg(BenchmarkSeed);
+			Xoshiro256pp xoshiro(BenchmarkSeed);
+
+			double mt_rate = PlayoutsPerSecond(game, playouts, mt);
+			printf("  std::mt19937: %10.0f playouts/s\n", mt_rate);
+			double pcg_rate = PlayoutsPerSecond(game, playouts, pcg);
+			printf("  pcg32:        %10.0f playouts/s, %5.2fx\n", pcg_rate, pcg_rate / mt_rate);
+			double xoshiro_rate = PlayoutsPerSecond(game, playouts, xoshiro);
+			printf("  xoshiro256++: %10.0f playouts/s, %5.2fx\n", xoshiro_rate, xoshiro_rate / mt_rate);
+		}
+	},	{
+		"UCT child selection with the direct formula or the table kernel (1000 nodes x 1000 selections of 32 children)", []( )
+		{
+			const unsigned nodes = 1000;
+			const unsigned selections = 1000;
+			const unsigned num = 32;
+
+			Random r(BenchmarkSeed);
+			uint32_t wins[num];
+			uint32_t start_visits[num];
+			uint32_t start_parent_visits = 0;
+			for (unsigned i = 0; i < num; ++i)
+			{
+				start_visits[i] = 1 + RandomBelow(r, 200);
+				wins[i] = RandomBelow(r, start_visits[i] + 1);
+				start_parent_visits += start_visits[i];
+			}
+
+			// How the searches used to score children. Each node starts from the same statistics,
+			// and the chosen child gets a visit like it would in a search.
+			unsigned checksum = 0;
+			auto start = HighResClock::now( );
+			for (unsigned n = 0; n < nodes; ++n)
+			{
+				uint32_t visits[num];
+				uint32_t parent_visits = start_parent_visits;
+				std::copy(start_visits, start_visits + num, visits);
+				for (unsigned s = 0; s < selections; ++s)
+				{
+					unsigned best = 0;
+					float best_score = -1.0f;
+					for (unsigned i = 0; i < num; ++i)
+					{
+						float score = (wins[i] / (float)visits[i]) + sqrtf(logf((float)parent_visits) / visits[i]);
+						if (score > best_score)
+						{
+							best = i;
+							best_score = score;
+						}
+					}
+					++visits[best];
+					++parent_visits;
+					checksum += best;
+				}
+			}
+			double direct_rate = nodes * selections / SecondsSince(start);
+			printf("  direct: %12.0f selections/s\n", direct_rate);
+
+			start = HighResClock::now( );
+			for (unsigned n = 0; n < nodes; ++n)
+			{
+				uint32_t visits[num];
+				uint32_t parent_visits = start_parent_visits;
+				std::copy(start_visits, start_visits + num, visits);
+				for (unsigned s = 0; s < selections; ++s)
+				{
+					float scores[num];
+					UCTScores(wins, visits, num, parent_visits, scores);
+					const unsigned best = BestScore(scores, num);
+					++visits[best];
+					++parent_visits;
+					checksum += best;
+				}
+			}
+			double kernel_rate = nodes * selections / SecondsSince(start);
+			printf("  kernel: %12.0f selections/s, %5.2fx\n", kernel_rate, kernel_rate / direct_rate);
+
+			if (checksum == 0)
+			{
+				printf("  (checksum %u)\n", checksum);
+			}
+		}
+	},
+};
+
+void RunBenchmarks( )
+{
+	for (const Benchmark& benchmark : Benchmarks)
+	{
+		printf("%s\n", benchmark.m_name);
+		benchmark.m_func( );
+	}
+}
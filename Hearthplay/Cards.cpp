@@ -1,5 +1,7 @@
 #include "Cards.h"
 
+#include <cstdio>
+#include <cstdlib>
 #include <random>
 
 static const MinionAura Aura_PlusTwoAttack = { MinionAuraEffect::BonusAttack, 2, AuraDuration::EndOfTurn };
@@ -243,6 +245,61 @@ const CardData* GetCardData(Card c)
 	return &AllCards[(unsigned)c];
 }
 
+Card GetCard(const CardData* data)
+{
+	return (Card)(data - AllCards);
+}
+
+// Defined after AllCards so it is built from the finished card data
+struct TargetedCardNumbering
+{
+	uint8_t m_index[(unsigned)Card::MAX];
+	Card m_cards[MaxTargetedCards];
+
+	TargetedCardNumbering( )
+	{
+		uint8_t num = 0;
+		for (unsigned c = 0; c < (unsigned)Card::MAX; ++c)
+		{
+			const CardData* data = GetCardData((Card)c);
+			const TargetType target_type = data->m_type == CardType::Minion ? data->m_minion_battlecry.m_target_type : data->m_spell_data.m_target_type;
+			switch (target_type)
+			{
+			case TargetType::AnyCharacter:
+			case TargetType::AnyMinion:
+			case TargetType::AnyPlayer:
+			case TargetType::Opponent:
+			case TargetType::SelfPlayer:
+				// The card table isn't a compile time constant, so this can't be a static_assert. Checked in
+				// every build, since overflowing would write past m_cards and shift every targeted move id.
+				if (num == MaxTargetedCards)
+				{
+					fprintf(stderr, "More targeted cards than MaxTargetedCards (%u)\n", (unsigned)MaxTargetedCards);
+					abort( );
+				}
+				m_cards[num] = (Card)c;
+				m_index[c] = num++;
+				break;
+			default:
+				m_index[c] = NotTargeted;
+				break;
+			}
+		}
+	}
+};
+
+static const TargetedCardNumbering TargetedCards;
+
+uint8_t GetTargetedCardIndex(Card c)
+{
+	return TargetedCards.m_index[(unsigned)c];
+}
+
+Card GetTargetedCard(uint8_t index)
+{
+	return TargetedCards.m_cards[index];
+}
+
 CardData::CardData(uint8_t mana_cost, const char* name, uint8_t attack, uint8_t health, CardFlags card_flags, MinionRace race, uint8_t minion_spelldamage)
 	: m_type(CardType::Minion)
 	, m_mana_cost(mana_cost)
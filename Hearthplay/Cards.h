@@ -3,7 +3,7 @@
 #include <cstdint>
 #include <vector>
 
-enum class Card
+enum class Card : uint8_t
 {
 	Coin,
 
@@ -265,6 +265,8 @@ enum class MinionAuraEffect : uint8_t
 {
 	None,
 	BonusAttack,
+
+	MAX,
 };
 
 enum class AuraDuration : uint8_t
@@ -272,6 +274,8 @@ enum class AuraDuration : uint8_t
 	None,
 	EndOfTurn,
 	Permanent,
+
+	MAX,
 };
 
 struct MinionAura
@@ -429,6 +433,14 @@ struct CardData
 };
 
 const CardData* GetCardData(Card c);
+Card GetCard(const CardData* data);
+
+// The cards that are played at a chosen target, by the spell or the minion's battlecry, numbered from 0
+// in card order. Any other card's index is NotTargeted.
+static const uint8_t MaxTargetedCards = 24;
+static const uint8_t NotTargeted = 0xFF;
+uint8_t GetTargetedCardIndex(Card c);
+Card GetTargetedCard(uint8_t index);
 
 extern std::vector<Card> DeckPossibleCards;
 void FilterDeckPossibleCards( );
\ No newline at end of file
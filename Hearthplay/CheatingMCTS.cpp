@@ -1,157 +1,92 @@
 #include "MCTS.h"
-#include "GameState.h"
-
-#include <memory>
-#include <math.h>
-
-#if 0
-#define MCTS_DEBUG(...) __VA_ARGS__
-#else
-#define MCTS_DEBUG(...) 
-#endif
+#include "MCTSCore.h"
 
 namespace CheatingMCTS
 {
-	struct MCTSNode
-	{
-		MCTSNode*					m_parent;
-		std::unique_ptr<MCTSNode>	m_child;
-		std::unique_ptr<MCTSNode>	m_sibling;
-
-		Move m_move; // The move that got us here from Parent
-		decltype(GameState::m_possible_moves) m_num_untried_moves;
-
-		uint32_t m_visits;
-		uint32_t m_wins;
+	// The cheating search sees the whole state, so nodes reached by different move orders are the same
+	// position. They are shared through a transposition table, which makes the tree a DAG where a node can
+	// have several parents.
+	typedef MCTSCore::Core<MCTSCore::PerfectInformation, MCTSCore::UCB1, MCTSNode, TranspositionTable<MCTSNode> > Core;
 
-		MCTSNode(const GameState& state)
-			: m_move(Move::EndTurn())
-		{
-			memset(this, 0, sizeof(MCTSNode));
-			m_num_untried_moves = state.m_possible_moves;
-		}
+	Move ChooseMove(const GameState& game, const SearchBudget& budget, uint64_t seed, unsigned* out_iterations)
+	{
+		const SearchLimit limit(budget, HighResClock::now( ));
+		Random r(seed);
+		NodeArena arena;
+		TranspositionTable<MCTSNode> table;
+		std::vector<PathStep> path;
+		UndoJournal journal;
+
+		const NodeArena::Index root = Core::NewRoot(arena, table, game);
+		const unsigned iterations = Core::RunIterations(root, game, limit, arena, table, path, journal, r);
+		if (out_iterations)
+			*out_iterations = iterations;
+		return Core::MostVisitedMove(root, arena, game);
+	}
 
-		MCTSNode(MCTSNode* parent, Move m, const GameState& state)
-			: m_move(Move::EndTurn( ))
-		{
-			memset(this, 0, sizeof(MCTSNode));
-			m_num_untried_moves = state.m_possible_moves;
-			m_move = m;
-			m_parent = parent;
-		}
+	Search::Search(const SearchBudget& budget, size_t table_bytes)
+		: m_arena_index(0)
+		, m_root(NodeArena::NoIndex)
+		, m_root_moved(false)
+		, m_budget(budget)
+		, m_random(GlobalRandomDevice( ))
+		, m_table(table_bytes)
+	{
+	}
 
-		MCTSNode(const MCTSNode& other) = delete;
+	void Search::Reset( )
+	{
+		m_root = NodeArena::NoIndex;
+		m_root_moved = false;
+	}
 
-		inline bool HasUntriedMoves()
-		{
-			return m_num_untried_moves.Num() != 0;
-		}
+	void Search::Seed(uint64_t seed)
+	{
+		m_random = Random(seed);
+	}
 
-		inline bool HasChildren()
+	void Search::MovePlayed(const Move& m)
+	{
+		if (m_root != NodeArena::NoIndex)
 		{
-			return m_child != nullptr;
+			const NodeArena& arena = m_arenas[m_arena_index];
+			m_root = arena.Get<MCTSNode>(m_root)->FindChild(arena, m);
+			m_root_moved = true;
 		}
+	}
 
-		inline MCTSNode* UCTSelectChild()
-		{
-			MCTSNode* best_child = nullptr;
-			float best_score = -1.0f;
-
-			for (MCTSNode* node = m_child.get(); node; node = node->m_sibling.get())
-			{
-				float score = (node->m_wins / (float)node->m_visits)
-					+ (float)sqrtf(log((float)m_visits) / node->m_visits); // TODO tiebreak?
-				if (score > best_score)
-				{
-					best_child = node;
-					best_score = score;
-				}
-			}
-
-			return best_child;
-		}
+	Move Search::ChooseMove(const GameState& game, unsigned* out_iterations)
+	{
+		// Compacting the graph counts against the time too
+		const SearchLimit limit(m_budget, HighResClock::now( ));
+		Random& r = m_random;
 
-		inline Move RemoveRandomUntriedMove(std::mt19937& r)
+		if (m_root != NodeArena::NoIndex && !m_arenas[m_arena_index].Get<MCTSNode>(m_root)->Matches(game))
 		{
-			std::uniform_int_distribution<uint16_t> move_dist(0, m_num_untried_moves.Num( ) - 1);
-
-			uint16_t index = move_dist(r);
-			Move m = m_num_untried_moves[index];
-			m_num_untried_moves.RemoveAt(index); // TODO: RemoveSwap
-
-			return m;
+			m_root = NodeArena::NoIndex;
 		}
 
-		inline MCTSNode* AddChild(Move m, const GameState& state)
+		if (m_root != NodeArena::NoIndex && m_root_moved)
 		{
-			std::unique_ptr<MCTSNode> new_node = std::make_unique<MCTSNode>(this, m, state);
-
-			for (MCTSNode* node = m_child.get(); node; node = node->m_sibling.get())
-			{
-				if (!node->m_sibling.get())
-				{
-					node->m_sibling = std::move(new_node);
-					return node->m_sibling.get();
-				}
-			}
-
-			m_child = std::move(new_node);
-			return m_child.get();
+			// Copy the part of the graph we kept into the other arena so everything else can be thrown away at once
+			NodeArena& to = m_arenas[m_arena_index ^ 1];
+			to.Reset( );
+			m_root = Core::CopyGraph(m_root, m_arenas[m_arena_index], to, m_table, m_copy_stack);
+			m_arena_index ^= 1;
 		}
-	};
-
-	Move ChooseMove(const GameState& game, unsigned Iterations)
-	{
-		std::mt19937 r(GlobalRandomDevice());
+		m_root_moved = false;
 
-		MCTSNode root(game);
-		for (unsigned iter = 0; iter < Iterations; ++iter)
+		NodeArena& arena = m_arenas[m_arena_index];
+		if (m_root == NodeArena::NoIndex)
 		{
-			MCTS_DEBUG(printf("Iteration %d\n", iter));
-			GameState sim_state(game);
-			MCTSNode* node = &root;
-
-			// Fully expand each node before expanding its children
-			while (!node->HasUntriedMoves() && node->HasChildren())
-			{
-				node = node->UCTSelectChild();
-				MCTS_DEBUG(printf("Selection: "));
-				MCTS_DEBUG(sim_state.PrintMove(node->m_move));
-				sim_state.ProcessMove(node->m_move);
-			}
-
-			if (node->HasUntriedMoves())
-			{
-				Move m = node->RemoveRandomUntriedMove(r);
-				MCTS_DEBUG(printf("Expansion: "));
-				MCTS_DEBUG(sim_state.PrintMove(m));
-				sim_state.ProcessMove(m);
-				node = node->AddChild(m, sim_state);
-			}
-
-			sim_state.PlayOutRandomly(r);
-			bool won = sim_state.m_winner == (Winner)game.m_active_player_index;
-			MCTS_DEBUG(printf( "Simulation result: %d\n", sim_state.m_winner));
-
-			while (node)
-			{
-				node->m_visits++;
-				if (won) node->m_wins++;
-			
-				node = node->m_parent;
-			}
+			arena.Reset( );
+			m_table.Clear( );
+			m_root = Core::NewRoot(arena, m_table, game);
 		}
 
-		uint32_t max_visits = 0;
-		MCTSNode* best_child = nullptr;
-		for( MCTSNode* node = root.m_child.get(); node; node = node->m_sibling.get() )
-		{
-			if (node->m_visits > max_visits)
-			{
-				best_child = node;
-				max_visits = node->m_visits;
-			}
-		}
-		return best_child->m_move;
+		const unsigned iterations = Core::RunIterations(m_root, game, limit, arena, m_table, m_path, m_journal, r);
+		if (out_iterations)
+			*out_iterations = iterations;
+		return Core::MostVisitedMove(m_root, arena, game);
 	}
-}
\ No newline at end of file
+}
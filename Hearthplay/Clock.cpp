@@ -1,5 +1,7 @@
 #include "Clock.h"
 
+#if defined(_WIN32)
+
 #include <Windows.h>
 
 namespace
@@ -16,5 +18,22 @@ HighResClock::time_point HighResClock::now()
 {
 	LARGE_INTEGER count;
 	QueryPerformanceCounter(&count);
-	return time_point(duration(count.QuadPart * static_cast<rep>(period::den) / g_Frequency));
-}
\ No newline at end of file
+
+	// Whole seconds and the remainder are converted separately, as count * den overflows after a few hours of uptime
+	const rep seconds = count.QuadPart / g_Frequency;
+	const rep remainder = count.QuadPart % g_Frequency;
+	return time_point(duration(seconds * static_cast<rep>(period::den) + remainder * static_cast<rep>(period::den) / g_Frequency));
+}
+
+#else
+
+#include <time.h>
+
+HighResClock::time_point HighResClock::now()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return time_point(duration(static_cast<rep>(ts.tv_sec) * static_cast<rep>(period::den) + ts.tv_nsec));
+}
+
+#endif
@@ -1,219 +1,311 @@
 #include "MCTS.h"
+#include "MCTSCore.h"
+#include "Platform.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <map>
 #include <random>
 
-#if 0
-#define MCTS_DEBUG(...) __VA_ARGS__
-#else
-#define MCTS_DEBUG(...) 
-#endif
-
 namespace DeterminizedMCTS
 {
-	struct MCTSNode
-	{
-		MCTSNode* m_parent;
-		std::unique_ptr<MCTSNode> m_child;
-		std::unique_ptr<MCTSNode> m_sibling;
-
-		Move m_move; // The move that got us here from Parent
-		decltype(GameState::m_possible_moves) m_num_untried_moves;
-
-		uint32_t m_visits;
-		uint32_t m_wins;
+	// Each determinization is searched as if its guess at the hidden cards were the real state
+	typedef MCTSCore::Core<MCTSCore::SearchDeterminization, MCTSCore::UCB1, MCTSNode> Core;
 
-		MCTSNode(const GameState& state)
-			: m_move(Move::EndTurn( ))
-		{
-			memset(this, 0, sizeof(MCTSNode));
-			m_num_untried_moves = state.m_possible_moves;
-		}
+	static GameState Determinize(const GameState& game, Random& r)
+	{
+		GameState new_state(game);
+		MCTSCore::SearchDeterminization::SampleSearch(new_state, r);
+		return new_state;
+	}
 
-		MCTSNode(MCTSNode* parent, Move m, const GameState& state)
-			: m_move(Move::EndTurn( ))
+	// Whether a determinization that has followed the moves played since it was made still agrees with
+	// everything the player to act can see in the real game
+	static bool IsConsistent(const GameState& det_game, const GameState& game)
+	{
+		if (det_game.m_active_player_index != game.m_active_player_index
+			|| det_game.m_winner != game.m_winner)
 		{
-			memset(this, 0, sizeof(MCTSNode));
-			m_num_untried_moves = state.m_possible_moves;
-			m_move = m;
-			m_parent = parent;
+			return false;
 		}
 
-		MCTSNode(const MCTSNode& other)
-			: m_parent(other.m_parent)
-			, m_move(other.m_move)
-			, m_num_untried_moves(other.m_num_untried_moves)
-			, m_visits(other.m_visits)
-			, m_wins(other.m_wins)
+		for (uint8_t player_idx = 0; player_idx < 2; ++player_idx)
 		{
-			if (other.m_child.get())
+			const Player& det_player = det_game.m_players[player_idx];
+			const Player& player = game.m_players[player_idx];
+			if (det_player.m_health != player.m_health
+				|| det_player.m_mana != player.m_mana
+				|| det_player.m_max_mana != player.m_max_mana
+				|| det_player.m_minions.Num( ) != player.m_minions.Num( )
+				|| det_player.m_hand.Num( ) != player.m_hand.Num( )
+				|| det_player.m_deck.Num( ) != player.m_deck.Num( ))
 			{
-				m_child = std::make_unique<MCTSNode>(*other.m_child);
+				return false;
 			}
-			if (other.m_sibling.get())
+
+			for (uint8_t i = 0; i < player.m_minions.Num( ); ++i)
 			{
-				m_sibling = std::make_unique<MCTSNode>(*other.m_sibling);
+				const Minion& det_minion = det_player.m_minions[i];
+				const Minion& minion = player.m_minions[i];
+				if (det_minion.m_source_card != minion.m_source_card
+					|| det_minion.m_attack != minion.m_attack
+					|| det_minion.m_health != minion.m_health
+					|| det_minion.m_max_health != minion.m_max_health
+					|| det_minion.m_abilities != minion.m_abilities
+					|| det_minion.m_flags != minion.m_flags)
+				{
+					return false;
+				}
 			}
 		}
 
-		inline bool HasUntriedMoves()
+		const Player& det_active = det_game.m_players[game.m_active_player_index];
+		const Player& active = game.m_players[game.m_active_player_index];
+		for (uint8_t i = 0; i < active.m_hand.Num( ); ++i)
 		{
-			return m_num_untried_moves.Num() != 0;
+			if (det_active.m_hand[i] != active.m_hand[i])
+			{
+				return false;
+			}
 		}
 
-		inline bool HasChildren()
+		return true;
+	}
+
+	static unsigned RunIterations(NodeArena::Index root, const GameState& det_game, const SearchLimit& limit, NodeArena& arena, std::vector<PathStep>& path, UndoJournal& journal, Random& r)
+	{
+		MCTSCore::NoTranspositions<MCTSNode> no_transpositions;
+		return Core::RunIterations(root, det_game, limit, arena, no_transpositions, path, journal, r);
+	}
+
+	static void AddRootVisits(NodeArena::Index root, const NodeArena& arena, std::map<Move, uint32_t>& move_visits)
+	{
+		const MCTSNode* root_node = arena.Get<MCTSNode>(root);
+		for (uint16_t slot = 0; slot < root_node->m_num_children; ++slot)
 		{
-			return m_child != nullptr;
+			move_visits[root_node->Moves( )[slot]] += root_node->EdgeVisits( )[slot];
 		}
+	}
 
-		inline MCTSNode* UCTSelectChild()
+	static Move MostVisitedMove(const std::map<Move, uint32_t>& move_visits)
+	{
+		Move best_move = Move::EndTurn();
+		uint32_t best_visits = 0;
+		for (auto p : move_visits)
 		{
-			MCTSNode* best_child = nullptr;
-			float best_score = -1.0f;
-
-			for (MCTSNode* node = m_child.get(); node; node = node->m_sibling.get())
+			if (p.second > best_visits)
 			{
-				float score = (node->m_wins / (float)node->m_visits)
-					+ (float)sqrtf(log((float)m_visits) / node->m_visits); // TODO tiebreak?
-				if (score > best_score)
-				{
-					best_child = node;
-					best_score = score;
-				}
+				best_move = p.first;
+				best_visits = p.second;
 			}
-
-			return best_child;
 		}
 
-		inline Move RemoveRandomUntriedMove(std::mt19937& r)
-		{
-			std::uniform_int_distribution<uint16_t> move_dist(0, m_num_untried_moves.Num( ) - 1);
+		return best_move;
+	}
+
+	Move ChooseMove(const GameState& game, unsigned num_determinizations, const SearchBudget& budget, uint64_t seed, unsigned* out_iterations)
+	{
+		const SearchLimit limit(budget, HighResClock::now( ));
+		Random r(seed);
+		std::map<Move, uint32_t> move_visits;
+		NodeArena arena;
+		UndoJournal journal;
+		std::vector<PathStep> path;
+		unsigned iterations = 0;
 
-			uint16_t index = move_dist(r);
-			Move m = m_num_untried_moves[index];
-			m_num_untried_moves.RemoveAt(index); // TODO: RemoveSwap
+		for (unsigned det = 0; det < num_determinizations; ++det)
+		{
+			GameState det_game = Determinize(game, r);
+			arena.Reset( );
+			const NodeArena::Index root = MCTSNode::New(arena, det_game);
 
-			return m;
+			// Each determinization gets an even share of the time the ones before it left
+			iterations += RunIterations(root, det_game, limit.Slice(HighResClock::now( ), num_determinizations - det), arena, path, journal, r);
+			AddRootVisits(root, arena, move_visits);
 		}
 
-		inline MCTSNode* AddChild(Move m, const GameState& state)
+		if (out_iterations)
+			*out_iterations = iterations;
+		return MostVisitedMove(move_visits);
+	}
+
+	Move ChooseMove(const GameState& game, unsigned num_determinizations, const SearchBudget& budget, unsigned num_threads, uint64_t seed, unsigned* out_iterations)
+	{
+		const SearchLimit limit(budget, HighResClock::now( ));
+
+		// Each thread adds its root visits to its own row, indexed like game.m_possible_moves
+		struct ALIGN_TO(64) VisitRow
 		{
-			std::unique_ptr<MCTSNode> new_node = std::make_unique<MCTSNode>(this, m, state);
+			uint32_t m_visits[GameState::MaxPossibleMoves];
+		};
+		VisitRow rows[ThreadPool::MaxThreads];
+
+		ThreadPool& pool = ThreadPool::Shared( );
+		const unsigned num_rows = pool.NumThreads( );
+		memset(rows, 0, sizeof(VisitRow) * num_rows);
 
-			for (MCTSNode* node = m_child.get(); node; node = node->m_sibling.get())
+		// Jobs are handed out in order, so a determinization shares the time left with the others
+		// still to come on its thread
+		const unsigned threads_used = std::max(std::min(std::min(num_threads, num_rows), num_determinizations), 1u);
+		std::atomic<unsigned> iterations(0);
+
+		// Each thread builds its trees in an arena of its own, and reuses a path buffer of its own
+		std::unique_ptr<NodeArena[]> arenas(new NodeArena[threads_used]);
+		std::vector< std::vector<PathStep> > paths(threads_used);
+
+		pool.ParallelFor(num_determinizations, num_threads, [&](unsigned det, unsigned thread_index)
+		{
+			// Every determinization gets its own generator, whichever thread it lands on
+			Random r(StreamSeed(seed, 0, det));
+			NodeArena& arena = arenas[thread_index];
+			arena.Reset( );
+
+			std::vector<PathStep>& path = paths[thread_index];
+			UndoJournal journal;
+			GameState det_game = Determinize(game, r);
+			const NodeArena::Index root = MCTSNode::New(arena, det_game);
+			const unsigned parts = (num_determinizations - det + threads_used - 1) / threads_used;
+			iterations.fetch_add(RunIterations(root, det_game, limit.Slice(HighResClock::now( ), parts), arena, path, journal, r), std::memory_order_relaxed);
+
+			VisitRow& row = rows[thread_index];
+			const MCTSNode* root_node = arena.Get<MCTSNode>(root);
+			for (uint16_t slot = 0; slot < root_node->m_num_children; ++slot)
 			{
-				if (!node->m_sibling.get())
+				decltype(game.m_possible_moves)::SizeType idx;
+				if (game.m_possible_moves.Find(root_node->Moves( )[slot], idx))
 				{
-					node->m_sibling = std::move(new_node);
-					return node->m_sibling.get();
+					row.m_visits[idx] += root_node->EdgeVisits( )[slot];
 				}
 			}
+		});
 
-			m_child = std::move(new_node);
-			return m_child.get();
-		}
-	};
+		Move best_move = Move::EndTurn( );
+		uint32_t best_visits = 0;
+		for (uint16_t idx = 0; idx < game.m_possible_moves.Num( ); ++idx)
+		{
+			uint32_t visits = 0;
+			for (unsigned row = 0; row < num_rows; ++row)
+			{
+				visits += rows[row].m_visits[idx];
+			}
 
-	static GameState Determinize(const GameState& game, std::mt19937& r)
-	{
-		GameState new_state(game);
+			if (visits > best_visits)
+			{
+				best_move = game.m_possible_moves[idx];
+				best_visits = visits;
+			}
+		}
 
-		int8_t opponent_idx = (int8_t)abs(new_state.m_active_player_index - 1);
-		Player& active = new_state.m_players[new_state.m_active_player_index];
-		Player& opponent = new_state.m_players[opponent_idx];
+		if (out_iterations)
+			*out_iterations = iterations.load( );
+		return best_move;
+	}
 
-		std::uniform_int_distribution<uint32_t> hand_distribution(0, DeckPossibleCards.size() );
-		std::uniform_int_distribution<uint32_t> deck_distribution(0, DeckPossibleCards.size() - 1);
+	Search::Search(unsigned num_determinizations, const SearchBudget& budget)
+		: m_arena_index(0)
+		, m_root_moved(false)
+		, m_budget(budget)
+		, m_random(GlobalRandomDevice( ))
+		, m_determinizations(num_determinizations)
+	{
+		Reset( );
+	}
 
-		// Randomize cards in opponent's hand
-		for (uint8_t i = 0; i < opponent.m_hand.Num(); ++i)
+	void Search::Reset( )
+	{
+		for (Determinization& det : m_determinizations)
 		{
-			auto idx = hand_distribution(r);
-			Card c = idx == DeckPossibleCards.size() ? Card::Coin : DeckPossibleCards[idx];
-			opponent.m_hand[i] = c;
+			det.m_root = NodeArena::NoIndex;
 		}
+		m_root_moved = false;
+	}
 
-		// Shuffle my deck
-		active.m_deck.Shuffle(r);
+	void Search::Seed(uint64_t seed)
+	{
+		m_random = Random(seed);
+	}
 
-		// Randomize opponent's deck
-		for (uint8_t i = 0; i < opponent.m_deck.Num(); ++i)
+	void Search::MovePlayed(const Move& m)
+	{
+		const NodeArena& arena = m_arenas[m_arena_index];
+		for (Determinization& det : m_determinizations)
 		{
-			Card c = DeckPossibleCards[deck_distribution(r)];
-			opponent.m_deck[i] = c;
-		}
+			if (det.m_root == NodeArena::NoIndex)
+				continue;
 
-		// This should not have actually changed the possible moves, but just to be safe against future changes
-		new_state.UpdatePossibleMoves();
-
-		return new_state;
+			if (det.m_state.m_legal_moves.Contains(m))
+			{
+				det.m_state.ProcessMove(m);
+				det.m_root = arena.Get<MCTSNode>(det.m_root)->FindChild(arena, m);
+			}
+			else
+			{
+				det.m_root = NodeArena::NoIndex;
+			}
+		}
+		m_root_moved = true;
 	}
 
-	Move ChooseMove(const GameState& game, unsigned num_determinizations, unsigned num_iterations)
+	Move Search::ChooseMove(const GameState& game, unsigned* out_iterations)
 	{
-		std::mt19937 r(GlobalRandomDevice());
+		// Compacting the trees counts against the time too
+		const SearchLimit limit(m_budget, HighResClock::now( ));
+		Random& r = m_random;
 		std::map<Move, uint32_t> move_visits;
 
-		for (unsigned det = 0; det < num_determinizations; ++det)
+		for (Determinization& det : m_determinizations)
 		{
-			GameState det_game = Determinize(game, r); // TODO: Determinize
-			MCTSNode root(det_game);
-
-			for (unsigned iter = 0; iter < num_iterations; ++iter)
+			if (det.m_root != NodeArena::NoIndex && !IsConsistent(det.m_state, game))
 			{
-				MCTS_DEBUG(printf("Iteration %d\n", iter));
-				GameState sim_state(det_game);
-				MCTSNode* node = &root;
-
-				// Fully expand each node before expanding its children
-				while (!node->HasUntriedMoves() && node->HasChildren())
-				{
-					node = node->UCTSelectChild();
-					MCTS_DEBUG(printf("Selection: "));
-					MCTS_DEBUG(sim_state.PrintMove(node->m_move));
-					sim_state.ProcessMove(node->m_move);
-				}
-
-				if (node->HasUntriedMoves())
-				{
-					Move m = node->RemoveRandomUntriedMove(r);
-					MCTS_DEBUG(printf("Expansion: "));
-					MCTS_DEBUG(sim_state.PrintMove(m));
-					sim_state.ProcessMove(m);
-					node = node->AddChild(m, sim_state);
-				}
-
-				sim_state.PlayOutRandomly(r);
-				bool won = sim_state.m_winner == (Winner)game.m_active_player_index;
-				MCTS_DEBUG(printf("Simulation result: %d\n", sim_state.m_winner));
+				det.m_root = NodeArena::NoIndex;
+			}
+		}
 
-				while (node)
+		NodeArena& arena = m_arenas[m_arena_index ^ (m_root_moved ? 1 : 0)];
+		if (m_root_moved)
+		{
+			// Copy the subtrees we kept into the other arena so everything else can be thrown away at once
+			MCTSCore::NoTranspositions<MCTSNode> no_transpositions;
+			arena.Reset( );
+			for (Determinization& det : m_determinizations)
+			{
+				if (det.m_root != NodeArena::NoIndex)
 				{
-					node->m_visits++;
-					if (won) node->m_wins++;
-
-					node = node->m_parent;
+					det.m_root = Core::CopyGraph(det.m_root, m_arenas[m_arena_index], arena, no_transpositions, m_copy_stack);
 				}
 			}
+			m_arena_index ^= 1;
+			m_root_moved = false;
+		}
 
-			for (MCTSNode* node = root.m_child.get(); node; node = node->m_sibling.get())
-			{
-				move_visits[node->m_move] += node->m_visits;
-			}
+		bool any_kept = false;
+		for (Determinization& det : m_determinizations)
+		{
+			any_kept |= det.m_root != NodeArena::NoIndex;
+		}
+		if (!any_kept)
+		{
+			arena.Reset( );
 		}
 
-		Move best_move = Move::EndTurn();
-		uint32_t best_visits = 0;
-		for (auto p : move_visits)
+		unsigned iterations = 0;
+		for (size_t i = 0; i < m_determinizations.size( ); ++i)
 		{
-			if (p.second > best_visits)
+			Determinization& det = m_determinizations[i];
+			if (det.m_root == NodeArena::NoIndex)
 			{
-				best_move = p.first;
-				best_visits = p.second;
+				det.m_state = Determinize(game, r);
+				det.m_root = MCTSNode::New(arena, det.m_state);
 			}
+
+			iterations += RunIterations(det.m_root, det.m_state, limit.Slice(HighResClock::now( ), (unsigned)(m_determinizations.size( ) - i)), arena, m_path, m_journal, r);
+			AddRootVisits(det.m_root, arena, move_visits);
 		}
 
-		return best_move;
+		if (out_iterations)
+			*out_iterations = iterations;
+		return MostVisitedMove(move_visits);
 	}
 }
\ No newline at end of file
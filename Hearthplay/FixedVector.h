@@ -1,5 +1,7 @@
 #pragma once
 
+#include "Random.h"
+
 #include <memory>
 #include <random>
 
@@ -51,6 +53,12 @@ public:
 		m_size = 0;
 	}
 
+	// Any elements added by growing are left as they were
+	inline void Resize(SizeType num)
+	{
+		m_size = num;
+	}
+
 	inline T PopBack( )
 	{
 		--m_size;
@@ -90,16 +98,27 @@ public:
 		m_size = num;
 	}
 
-	inline void Shuffle(std::mt19937& r) // TODO: Use ,random>
+	template<typename RandomType>
+	inline void Shuffle(RandomType& r)
 	{
 		for (SizeType i = 0; i < m_size; ++i)
 		{
-			std::uniform_int_distribution<uint32_t> dist(i, m_size - 1); // Ideally use a template to generate shorts when SizeType is char
-			SizeType j = (SizeType)dist(r);
+			SizeType j = (SizeType)(i + RandomBelow(r, m_size - i));
 			std::swap(m_data[i], m_data[j]);
 		}
 	}
 
+	// Pass the bytes of this vector that are in use to func(ptr, num_bytes), so they can be saved and restored
+	template<typename FuncType>
+	inline void ForEachUsedRange(FuncType func)
+	{
+		func(&m_size, sizeof(m_size));
+		if (m_size)
+		{
+			func(&m_data[0], m_size * sizeof(T));
+		}
+	}
+
 	inline bool Contains(const T& t) const
 	{
 		for (SizeType i = 0; i < m_size; ++i)
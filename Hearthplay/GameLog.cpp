@@ -0,0 +1,224 @@
+// fopen is fine here, and SDL checks would make its deprecation warning an error
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "GameLog.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const size_t RecordHeaderBytes = 8 + 4 + 2 + 2 + 1 + 1 + 1;
+
+template<typename T>
+static inline uint8_t* Put(uint8_t* out, T value)
+{
+	memcpy(out, &value, sizeof(T));
+	return out + sizeof(T);
+}
+
+template<typename T>
+static inline const uint8_t* Get(const uint8_t* in, T& value)
+{
+	memcpy(&value, in, sizeof(T));
+	return in + sizeof(T);
+}
+
+GameRecord::GameRecord( )
+	: m_seed(0)
+	, m_deck_id(0)
+	, m_turns(0)
+	, m_player_one(AIType::Random)
+	, m_player_two(AIType::Random)
+	, m_winner(Winner::Undetermined)
+{
+}
+
+GameLog::GameLog( )
+	: m_file(nullptr)
+{
+}
+
+GameLog::~GameLog( )
+{
+	Close( );
+}
+
+bool GameLog::Open(const char* path)
+{
+	Close( );
+	m_file = fopen(path, "wb");
+	if (!m_file)
+	{
+		return false;
+	}
+
+	uint8_t header[8];
+	Put(Put(header, Magic), Version);
+	WriteBlock(header, sizeof(header));
+	return true;
+}
+
+void GameLog::Close( )
+{
+	if (m_file)
+	{
+		fclose(m_file);
+		m_file = nullptr;
+	}
+}
+
+void GameLog::WriteBlock(const uint8_t* data, size_t size)
+{
+	if (m_file && size)
+	{
+		fwrite(data, 1, size, m_file);
+	}
+}
+
+GameLogWriter::GameLogWriter(GameLog& log)
+	: m_log(log)
+{
+	m_buffer.reserve(FlushBytes);
+}
+
+GameLogWriter::~GameLogWriter( )
+{
+	Flush( );
+}
+
+void GameLogWriter::Append(const GameRecord& record)
+{
+	const uint16_t num_moves = (uint16_t)std::min<size_t>(record.m_think_us.size( ), UINT16_MAX);
+	const size_t start = m_buffer.size( );
+	m_buffer.resize(start + RecordHeaderBytes + num_moves * sizeof(uint32_t));
+
+	uint8_t* out = &m_buffer[start];
+	out = Put(out, record.m_seed);
+	out = Put(out, record.m_deck_id);
+	out = Put(out, record.m_turns);
+	out = Put(out, num_moves);
+	out = Put(out, (uint8_t)record.m_player_one);
+	out = Put(out, (uint8_t)record.m_player_two);
+	out = Put(out, (int8_t)record.m_winner);
+	if (num_moves)
+	{
+		memcpy(out, record.m_think_us.data( ), num_moves * sizeof(uint32_t));
+	}
+
+	if (m_buffer.size( ) >= FlushBytes)
+	{
+		Flush( );
+	}
+}
+
+void GameLogWriter::Flush( )
+{
+	if (!m_buffer.empty( ))
+	{
+		m_log.WriteBlock(m_buffer.data( ), m_buffer.size( ));
+		m_buffer.clear( );
+	}
+}
+
+GameLogReader::GameLogReader( )
+	: m_file(nullptr)
+{
+}
+
+GameLogReader::~GameLogReader( )
+{
+	if (m_file)
+	{
+		fclose(m_file);
+	}
+}
+
+bool GameLogReader::Open(const char* path)
+{
+	if (m_file)
+	{
+		fclose(m_file);
+	}
+
+	m_file = fopen(path, "rb");
+	if (!m_file)
+	{
+		return false;
+	}
+
+	uint8_t header[8];
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	if (fread(header, 1, sizeof(header), m_file) != sizeof(header))
+	{
+		return false;
+	}
+	Get(Get(header, magic), version);
+	return magic == GameLog::Magic && version == GameLog::Version;
+}
+
+bool GameLogReader::Next(GameRecord& out_record)
+{
+	uint8_t header[RecordHeaderBytes];
+	if (!m_file || fread(header, 1, sizeof(header), m_file) != sizeof(header))
+	{
+		return false;
+	}
+
+	uint16_t num_moves;
+	uint8_t player_one, player_two;
+	int8_t winner;
+	const uint8_t* in = header;
+	in = Get(in, out_record.m_seed);
+	in = Get(in, out_record.m_deck_id);
+	in = Get(in, out_record.m_turns);
+	in = Get(in, num_moves);
+	in = Get(in, player_one);
+	in = Get(in, player_two);
+	in = Get(in, winner);
+	out_record.m_player_one = (AIType)player_one;
+	out_record.m_player_two = (AIType)player_two;
+	out_record.m_winner = (Winner)winner;
+
+	out_record.m_think_us.resize(num_moves);
+	return num_moves == 0 || fread(out_record.m_think_us.data( ), sizeof(uint32_t), num_moves, m_file) == num_moves;
+}
+
+bool ConvertGameLogToCSV(const char* log_path, const char* csv_path)
+{
+	GameLogReader reader;
+	if (!reader.Open(log_path))
+	{
+		return false;
+	}
+
+	FILE* csv = fopen(csv_path, "w");
+	if (!csv)
+	{
+		return false;
+	}
+
+	static const char* WinnerNames[] = { "PlayerOne", "PlayerTwo", "Draw" };
+	fprintf(csv, "seed,deck,player_one,player_two,winner,turns,moves,think_us\n");
+
+	GameRecord record;
+	while (reader.Next(record))
+	{
+		const bool valid_ais = record.m_player_one < AIType::MAX && record.m_player_two < AIType::MAX;
+		fprintf(csv, "%llu,%u,%s,%s,%s,%u,%u,",
+				(unsigned long long)record.m_seed,
+				record.m_deck_id,
+				valid_ais ? AINames[(int)record.m_player_one] : "?",
+				valid_ais ? AINames[(int)record.m_player_two] : "?",
+				record.m_winner >= Winner::PlayerOne && record.m_winner <= Winner::Draw ? WinnerNames[(int)record.m_winner] : "Undetermined",
+				(unsigned)record.m_turns,
+				(unsigned)record.m_think_us.size( ));
+		for (size_t i = 0; i < record.m_think_us.size( ); ++i)
+		{
+			fprintf(csv, i ? " %u" : "%u", record.m_think_us[i]);
+		}
+		fprintf(csv, "\n");
+	}
+
+	fclose(csv);
+	return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "GameState.h"
+#include "Tournament.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Compact binary log of finished tournament games, for runs too long to print every game.
+//
+// The file starts with GameLog::Magic and GameLog::Version, followed by one record per game, little endian:
+//	uint64	seed the game was played from
+//	uint32	deck id, the same for every game played with the same deck
+//	uint16	turns
+//	uint16	moves
+//	uint8	player one's AIType
+//	uint8	player two's AIType
+//	int8	Winner
+//	uint32	time spent choosing each move in microseconds, one per move
+struct GameRecord
+{
+	uint64_t	m_seed;
+	uint32_t	m_deck_id;
+	uint16_t	m_turns;
+	AIType		m_player_one;
+	AIType		m_player_two;
+	Winner		m_winner;
+	std::vector<uint32_t> m_think_us;
+
+	GameRecord( );
+};
+
+class GameLog
+{
+public:
+	static const uint32_t Magic = 0x4C475048; // "HPGL"
+	static const uint32_t Version = 1;
+
+	GameLog( );
+	~GameLog( );
+
+	GameLog(const GameLog& other) = delete;
+	GameLog& operator=(const GameLog& other) = delete;
+
+	// Creates or truncates the file and writes the header
+	bool Open(const char* path);
+	void Close( );
+
+	// Appends whole records. Writers on different threads each call this once per buffer they fill, and the
+	// only locking is the FILE's own, so records from different threads interleave but never mix.
+	void WriteBlock(const uint8_t* data, size_t size);
+
+private:
+	FILE* m_file;
+};
+
+// Buffers the records of one thread and writes them to the log in large blocks. Flushes when destroyed.
+class GameLogWriter
+{
+public:
+	static const size_t FlushBytes = 64 * 1024;
+
+	GameLogWriter(GameLog& log);
+	~GameLogWriter( );
+
+	GameLogWriter(const GameLogWriter& other) = delete;
+	GameLogWriter& operator=(const GameLogWriter& other) = delete;
+
+	void Append(const GameRecord& record);
+	void Flush( );
+
+private:
+	GameLog& m_log;
+	std::vector<uint8_t> m_buffer;
+};
+
+class GameLogReader
+{
+public:
+	GameLogReader( );
+	~GameLogReader( );
+
+	GameLogReader(const GameLogReader& other) = delete;
+	GameLogReader& operator=(const GameLogReader& other) = delete;
+
+	// Fails if the file can't be opened or isn't a log of this version
+	bool Open(const char* path);
+
+	// Returns false at the end of the log, or at a record cut short
+	bool Next(GameRecord& out_record);
+
+private:
+	FILE* m_file;
+};
+
+// Writes one line per game, with the think times of its moves separated by spaces in the last column
+bool ConvertGameLogToCSV(const char* log_path, const char* csv_path);
@@ -3,70 +3,167 @@
 #include <memory>
 #include <random>
 #include <algorithm>
+#include <cassert>
+
+// Fixed random keys for Zobrist hashing, the same on every run
+struct ZobristKeys
+{
+	typedef decltype(Player::m_hand) Hand;
+	typedef decltype(Player::m_deck) Deck;
+
+	uint64_t m_health[2][256];
+	uint64_t m_mana[2][256];
+	uint64_t m_max_mana[2][256];
+	uint64_t m_hand[2][(unsigned)Card::MAX][Hand::Capacity];
+	uint64_t m_deck[2][Deck::Capacity][(unsigned)Card::MAX];
+	uint64_t m_minion_slot[2][MinionBoard::Capacity];
+	uint64_t m_active_player;
+
+	ZobristKeys( )
+	{
+		uint64_t state = 0x5EED5EED5EED5EEDull;
+		auto next = [&state]( ) { return Mix(state += 0x9E3779B97F4A7C15ull); };
+
+		for (uint8_t p = 0; p < 2; ++p)
+		{
+			for (auto& key : m_health[p]) key = next( );
+			for (auto& key : m_mana[p]) key = next( );
+			for (auto& key : m_max_mana[p]) key = next( );
+			for (auto& card_keys : m_hand[p]) for (auto& key : card_keys) key = next( );
+			for (auto& slot_keys : m_deck[p]) for (auto& key : slot_keys) key = next( );
+			for (auto& key : m_minion_slot[p]) key = next( );
+		}
+		m_active_player = next( );
+	}
+
+	// splitmix64 finalizer
+	static uint64_t Mix(uint64_t x)
+	{
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+
+	// Minions have too many states for a key each, so their fields are mixed with a key for their slot
+	uint64_t MinionKey(uint8_t player_index, uint8_t minion_index, const MinionBoard& board) const
+	{
+		uint64_t fields = (uint64_t)board.m_source_card[minion_index]
+			| (uint64_t)board.m_attack[minion_index] << 8
+			| (uint64_t)(uint8_t)board.m_health[minion_index] << 16
+			| (uint64_t)(uint8_t)board.m_max_health[minion_index] << 24
+			| (uint64_t)board.m_spelldamage[minion_index] << 32
+			| (uint64_t)board.m_abilities[minion_index] << 40
+			| (uint64_t)board.m_flags[minion_index] << 48;
+		uint64_t key = Mix(m_minion_slot[player_index][minion_index] ^ fields);
+		const uint8_t* aura_totals = &board.m_aura_totals[minion_index][0][0];
+		for (uint8_t i = 0; i < sizeof(MinionAuraTotals); ++i)
+		{
+			if (aura_totals[i])
+			{
+				key = Mix(key ^ ((uint64_t)aura_totals[i] | (uint64_t)(i + 1) << 8));
+			}
+		}
+		return key;
+	}
+};
+
+static const ZobristKeys Zobrist;
 
 void Player::Heal( uint8_t amt )
 {
 	m_health = std::min<int8_t>(m_health + amt, GameState::StartingHealth);
 }
 
-void Minion::Heal(uint8_t amt)
+GameStateCore::GameStateCore()
 {
-	m_health = std::min<int8_t>(m_health + amt, m_max_health);
+	memset(static_cast<void*>(this), 0, sizeof(GameStateCore));
+	m_players[0].m_health = StartingHealth;
+	m_players[1].m_health = StartingHealth;
+
+	m_winner = Winner::Undetermined;
 }
 
-void Minion::AddAuraEffects(const MinionAura& aura)
+GameStateCore::GameStateCore(const GameStateCore& other)
 {
-	switch (aura.m_effect)
-	{
-	case MinionAuraEffect::BonusAttack:
-		m_attack += aura.m_param;
-		break;
-	} 
+	memcpy(static_cast<void*>(this), &other, sizeof(GameStateCore));
 }
 
-void Minion::RemoveAuraEffects(const MinionAura& aura)
+GameStateCore& GameStateCore::operator=(const GameStateCore& other)
 {
-	switch (aura.m_effect)
+	if (this != &other)
 	{
-	case MinionAuraEffect::BonusAttack:
-		m_attack -= aura.m_param;
-		break;
+		memcpy(static_cast<void*>(this), &other, sizeof(GameStateCore));
 	}
+	return *this;
 }
 
-void Minion::RemoveEndOfTurnAuras( )
+void GameStateCore::ProcessMove(const Move& m, UndoJournal* journal)
 {
-	if (m_auras.Num( ) == 0)
-		return;
+	// Pending spell effects are always empty between moves, so never need journaling
+	m_journal = journal;
+	Journal(m_hash);
 
-	for (uint8_t i = m_auras.Num( ) - 1; ; --i)
-	{
-		if (m_auras[i].m_duration == AuraDuration::EndOfTurn)
-		{
-			RemoveAuraEffects(m_auras[i]);
-			m_auras.RemoveSwap(i);
-		}
+	ApplyMove(m);
+	m_journal = nullptr;
 
-		if (i == 0)
-			break;
-	}
+#ifdef _DEBUG
+	assert(m_skip_hashing || m_hash == ComputeHash( ));
+	assert(m_players[0].m_minions.CachesMatch( ) && m_players[1].m_minions.CachesMatch( ));
+#endif
 }
 
 GameState::GameState()
 {
-	memset(this, 0, sizeof(GameState));
-	m_players[0].m_health = StartingHealth;
-	m_players[1].m_health = StartingHealth;
-
-	m_winner = Winner::Undetermined;
+	// No moves have been generated yet, so the first refresh has to build them all
+	m_possible_moves_source.m_active_player_index = -1;
 }
 
 GameState::GameState(const GameState& other)
+	: GameStateCore(other)
+{
+	memcpy(&m_possible_moves, &other.m_possible_moves, sizeof(m_possible_moves));
+	m_legal_moves = other.m_legal_moves;
+	m_possible_moves_source = other.m_possible_moves_source;
+}
+
+GameState& GameState::operator=(const GameState& other)
+{
+	if (this != &other)
+	{
+		GameStateCore::operator=(other);
+		memcpy(&m_possible_moves, &other.m_possible_moves, sizeof(m_possible_moves));
+		m_legal_moves = other.m_legal_moves;
+		m_possible_moves_source = other.m_possible_moves_source;
+	}
+	return *this;
+}
+
+void GameState::ProcessMove(const Move& m, UndoJournal* journal)
+{
+	if (journal)
+	{
+		JournalPossibleMoves(*journal);
+	}
+	GameStateCore::ProcessMove(m, journal);
+	RefreshPossibleMoves( );
+
+#ifdef _DEBUG
+	GameState rebuilt(*this);
+	rebuilt.GeneratePossibleMoves( );
+	assert(m_possible_moves.Num( ) == rebuilt.m_possible_moves.Num( )
+		&& memcmp(&m_possible_moves[0], &rebuilt.m_possible_moves[0], m_possible_moves.Num( ) * sizeof(Move)) == 0);
+	assert(memcmp(&m_legal_moves, &rebuilt.m_legal_moves, sizeof(MoveSet)) == 0);
+#endif
+}
+
+void GameState::JournalPossibleMoves(UndoJournal& journal)
 {
-	memcpy(this, &other, sizeof(GameState));
+	journal.Save(m_possible_moves);
+	journal.Save(m_legal_moves);
+	journal.Save(m_possible_moves_source);
 }
 
-void GameState::ProcessMove(const Move& m)
+void GameStateCore::ApplyMove(const Move& m)
 {
 	switch (m.m_type)
 	{
@@ -78,159 +175,501 @@ void GameState::ProcessMove(const Move& m)
 
 	while (m_pending_spell_effects.Num( ))
 	{
-		HandlePendingSpellEffect(m_pending_spell_effects[0].m_spell_data, m_pending_spell_effects[0].m_owner_index);
+		const PendingSpellEffect& pending = m_pending_spell_effects[0];
+		HandlePendingSpellEffect(GetCardData(pending.m_source_card)->m_minion_deathrattle, pending.m_owner_index);
 		m_pending_spell_effects.RemoveAt(0);
 	}
+}
 
-	UpdatePossibleMoves();
+void GameState::UpdatePossibleMoves( )
+{
+	m_players[0].m_minions.Refresh( );
+	m_players[1].m_minions.Refresh( );
+	m_hash = ComputeHash( );
+	GeneratePossibleMoves( );
 }
 
-void GameState::PlayOutRandomly( std::mt19937& r )
+uint64_t GameStateCore::ComputeHash( ) const
 {
-	while (m_winner == Winner::Undetermined)
+	uint64_t hash = m_active_player_index ? Zobrist.m_active_player : 0;
+	for (uint8_t player_index = 0; player_index < 2; ++player_index)
 	{
-		std::uniform_int_distribution<decltype(m_possible_moves.Num())> move_dist(0, m_possible_moves.Num() - 1);
-		auto idx = move_dist(r);
-		ProcessMove(m_possible_moves[idx]);
+		const Player& p = m_players[player_index];
+		hash ^= Zobrist.m_health[player_index][(uint8_t)p.m_health];
+		hash ^= Zobrist.m_mana[player_index][p.m_mana];
+		hash ^= Zobrist.m_max_mana[player_index][p.m_max_mana];
+
+		for (uint8_t i = 0; i < p.m_minions.Num( ); ++i)
+		{
+			hash ^= Zobrist.MinionKey(player_index, i, p.m_minions);
+		}
+
+		uint8_t copies[(unsigned)Card::MAX] = {};
+		for (uint8_t i = 0; i < p.m_hand.Num( ); ++i)
+		{
+			Card c = p.m_hand[i];
+			hash ^= Zobrist.m_hand[player_index][(unsigned)c][copies[(unsigned)c]++];
+		}
+
+		for (uint8_t i = 0; i < p.m_deck.Num( ); ++i)
+		{
+			hash ^= Zobrist.m_deck[player_index][i][(unsigned)p.m_deck[i]];
+		}
 	}
+	return hash;
 }
 
-void GameState::UpdatePossibleMoves( )
+void GameStateCore::HashHealth(uint8_t player_index)
 {
-	FixedVector< FixedVector<PackedTarget, MaxTargets, uint8_t>, (uint8_t)TargetType::MAX, uint8_t> target_map;
+	if (m_skip_hashing)
+		return;
+	m_hash ^= Zobrist.m_health[player_index][(uint8_t)m_players[player_index].m_health];
+}
 
-	uint8_t opponent_index = OppositePlayer(m_active_player_index);
+void GameStateCore::HashMana(uint8_t player_index)
+{
+	if (m_skip_hashing)
+		return;
+	m_hash ^= Zobrist.m_mana[player_index][m_players[player_index].m_mana];
+}
+
+void GameStateCore::HashMaxMana(uint8_t player_index)
+{
+	if (m_skip_hashing)
+		return;
+	m_hash ^= Zobrist.m_max_mana[player_index][m_players[player_index].m_max_mana];
+}
+
+void GameStateCore::HashMinion(uint8_t player_index, uint8_t minion_index)
+{
+	if (m_skip_hashing)
+		return;
+	m_hash ^= Zobrist.MinionKey(player_index, minion_index, m_players[player_index].m_minions);
+}
 
-	target_map[(uint8_t)TargetType::None].Add(Move::TargetNone());
-	target_map[(uint8_t)TargetType::Opponent].Add(Move::TargetPlayer(opponent_index));
-	target_map[(uint8_t)TargetType::SelfPlayer].Add(Move::TargetPlayer(m_active_player_index));
-	for (uint8_t i = 0; i < 2; ++i)
+void GameStateCore::HashMinions(uint8_t player_index)
+{
+	if (m_skip_hashing)
+		return;
+	for (uint8_t i = 0; i < m_players[player_index].m_minions.Num( ); ++i)
 	{
-		target_map[(uint8_t)TargetType::AnyPlayer].Add(Move::TargetPlayer(i));
+		HashMinion(player_index, i);
 	}
-	for (uint8_t player_index = 0; player_index < 2; ++player_index)
-	{
-		for (uint8_t minion_index = 0; minion_index < m_players[player_index].m_minions.Num( ); ++minion_index)
-		{
-			if (player_index == m_active_player_index || !m_players[player_index].m_minions[minion_index].HasStealth( ))
-			{
-				target_map[(uint8_t)TargetType::AnyCharacter].Add(Move::TargetMinion(player_index, minion_index));
-				target_map[(uint8_t)TargetType::AnyMinion].Add(Move::TargetMinion(player_index, minion_index));
-			}
-		}
+}
 
-		target_map[(uint8_t)TargetType::AnyCharacter].Add(Move::TargetPlayer(player_index));
+void GameStateCore::HashActivePlayer( )
+{
+	if (m_skip_hashing)
+		return;
+	m_hash ^= Zobrist.m_active_player;
+}
+
+void GameStateCore::HashHandCard(uint8_t player_index, Card c)
+{
+	if (m_skip_hashing)
+		return;
+	const auto& hand = m_players[player_index].m_hand;
+	uint8_t copies = 0;
+	for (uint8_t i = 0; i < hand.Num( ); ++i)
+	{
+		if (hand[i] == c)
+			++copies;
 	}
+	m_hash ^= Zobrist.m_hand[player_index][(unsigned)c][copies];
+}
 
-	m_possible_moves.Clear();
-	
-	Player& ActivePlayer = m_players[m_active_player_index];
-	Player& Opponent = m_players[opponent_index];
+void GameStateCore::DrawOne(uint8_t player_index)
+{
+	Player& p = m_players[player_index];
+	if (p.m_deck.Num( ) == 0)
+		return;
 
-	bool opponent_has_taunt = false;
-	for (uint8_t i = 0; i < Opponent.m_minions.Num( ); ++i)
+	Card c = p.m_deck[p.m_deck.Num( ) - 1];
+	if (!m_skip_hashing)
 	{
-		if (Opponent.m_minions[i].HasTaunt( ) && !Opponent.m_minions[i].HasStealth())
+		m_hash ^= Zobrist.m_deck[player_index][p.m_deck.Num( ) - 1][(unsigned)c];
+		if (p.m_hand.Num( ) < p.m_hand.Capacity)
 		{
-			opponent_has_taunt = true;
-			break;
+			HashHandCard(player_index, c);
 		}
 	}
+	p.DrawOne( );
+}
+
+PossibleMovesSource GameState::GetPossibleMovesSource( ) const
+{
+	PossibleMovesSource source;
+	source.m_active_player_index = m_active_player_index;
+	source.m_attackers = m_players[m_active_player_index].m_minions.CanAttackMask( );
+	source.m_attack_targets = AttackTargetMask(source.m_taunt);
+	source.m_num_attack_moves = PopCount(source.m_attackers) * (PopCount(source.m_attack_targets) + !source.m_taunt);
+	source.m_mana = m_players[m_active_player_index].m_mana;
+	source.m_targetable[0] = TargetableMask(0);
+	source.m_targetable[1] = TargetableMask(1);
+	source.m_hand = m_players[m_active_player_index].m_hand;
+	return source;
+}
+
+void GameState::GeneratePossibleMoves( )
+{
+	m_possible_moves_source = GetPossibleMovesSource( );
+
+	m_possible_moves.Resize(m_possible_moves_source.m_num_attack_moves);
+	WriteAttackMoves(m_possible_moves_source, &m_possible_moves[0]);
+	AddCardMoves(m_possible_moves_source);
+	m_possible_moves.Add(Move::EndTurn());
+
+	m_legal_moves.Clear( );
+	AddLegalMoves(0, m_possible_moves.Num( ));
+}
+
+void GameState::AddLegalMoves(uint16_t begin, uint16_t end)
+{
+	for (uint16_t i = begin; i < end; ++i)
+	{
+		m_legal_moves.Add(GetMoveId(m_possible_moves[i]));
+	}
+}
 
-	// Attack each target with each minion
-	for (uint8_t i = 0; i < ActivePlayer.m_minions.Num(); ++i)
+void GameState::RemoveLegalMoves(uint16_t begin, uint16_t end)
+{
+	for (uint16_t i = begin; i < end; ++i)
 	{
-		if (!ActivePlayer.m_minions[i].CanAttack())
-			continue;
+		m_legal_moves.Remove(GetMoveId(m_possible_moves[i]));
+	}
+}
 
-		for (uint8_t j = 0; j < Opponent.m_minions.Num( ); ++j)
-		{
-			if( opponent_has_taunt && !Opponent.m_minions[j].HasTaunt() )
-				continue;
+void GameState::RefreshPossibleMoves( )
+{
+	const PossibleMovesSource source = GetPossibleMovesSource( );
+	const bool same_attacks = source.SameAttacks(m_possible_moves_source);
+	const bool same_card_plays = source.SameCardPlays(m_possible_moves_source);
 
-			if( Opponent.m_minions[j].HasStealth() )
-				continue;
+	if (same_attacks && same_card_plays)
+	{
+		return;
+	}
 
+	if (same_card_plays)
+	{
+		// Slide the card plays and end turn along to fit the new attacks in front of them
+		const uint8_t old_num_attack_moves = m_possible_moves_source.m_num_attack_moves;
+		const uint16_t num_after_attacks = m_possible_moves.Num( ) - old_num_attack_moves;
+		RemoveLegalMoves(0, old_num_attack_moves);
+		m_possible_moves.Resize(source.m_num_attack_moves + num_after_attacks);
+		memmove(&m_possible_moves[source.m_num_attack_moves], &m_possible_moves[old_num_attack_moves], num_after_attacks * sizeof(Move));
+		WriteAttackMoves(source, &m_possible_moves[0]);
+		AddLegalMoves(0, source.m_num_attack_moves);
+		m_possible_moves_source = source;
+	}
+	else if (same_attacks)
+	{
+		// End turn is removed along with the card plays, and added back after them
+		RemoveLegalMoves(source.m_num_attack_moves, m_possible_moves.Num( ));
+		m_possible_moves.Resize(source.m_num_attack_moves);
+		AddCardMoves(source);
+		m_possible_moves.Add(Move::EndTurn());
+		AddLegalMoves(source.m_num_attack_moves, m_possible_moves.Num( ));
+		m_possible_moves_source = source;
+	}
+	else
+	{
+		GeneratePossibleMoves( );
+	}
+}
+
+// Attack each target with each minion
+void GameState::WriteAttackMoves(const PossibleMovesSource& source, Move* out) const
+{
+	for (uint8_t attackers = source.m_attackers; attackers; attackers &= attackers - 1)
+	{
+		const uint8_t i = NthSetBit(attackers, 0);
+		for (uint8_t targets = source.m_attack_targets; targets; targets &= targets - 1)
+		{
 			// Attack minion
-			m_possible_moves.Add(Move::AttackMinion(i, j));
+			*out++ = Move::AttackMinion(i, NthSetBit(targets, 0));
 		}
 
-		if (!opponent_has_taunt)
+		if (!source.m_taunt)
 		{
 			// Attack opponent
-			m_possible_moves.Add(Move::AttackHero(i));
+			*out++ = Move::AttackHero(i);
 		}
 	}
+}
 
-	// Play each card
-	for (uint8_t i = 0; i < ActivePlayer.m_hand.Num(); ++i)
+// Play each card
+void GameState::AddCardMoves(const PossibleMovesSource& source)
+{
+	for (uint8_t i = 0; i < source.m_hand.Num(); ++i)
 	{
-		Card c = ActivePlayer.m_hand[i];
+		Card c = source.m_hand[i];
 		const CardData* const data = GetCardData(c);
-		if (data->m_mana_cost > ActivePlayer.m_mana)
+		if (data->m_mana_cost > source.m_mana)
 			continue;
 
 		switch (data->m_type)
 		{
 		case CardType::Minion:
 		{
-			const auto& targets = target_map[(uint8_t)data->m_minion_battlecry.m_target_type];
-
-			for (uint8_t target_index = 0; target_index < targets.Num( ); ++target_index)
-			{
-				m_possible_moves.Add(Move::PlayCard(c, targets[target_index]));
-			}
+			const uint16_t num_before = m_possible_moves.Num( );
+			AddTargetedMoves(c, data->m_minion_battlecry.m_target_type, source);
 
 			// Can always(?) play minion battlecries with no target
-			if (targets.Num( ) == 0)
+			if (m_possible_moves.Num( ) == num_before)
 			{
 				m_possible_moves.Add(Move::PlayCard(c));
 			}
 		}
 			break;
 		case CardType::Spell:
+			AddTargetedMoves(c, data->m_spell_data.m_target_type, source);
+			break;
+		}
+	}
+}
+
+// Each target in the order GetTarget numbers them
+void GameState::AddTargetedMoves(Card c, TargetType type, const PossibleMovesSource& source)
+{
+	switch (type)
+	{
+	case TargetType::None:
+		m_possible_moves.Add(Move::PlayCard(c, Move::TargetNone( )));
+		return;
+	case TargetType::Opponent:
+		m_possible_moves.Add(Move::PlayCard(c, Move::TargetPlayer(OppositePlayer(source.m_active_player_index))));
+		return;
+	case TargetType::SelfPlayer:
+		m_possible_moves.Add(Move::PlayCard(c, Move::TargetPlayer(source.m_active_player_index)));
+		return;
+	case TargetType::AnyPlayer:
+		m_possible_moves.Add(Move::PlayCard(c, Move::TargetPlayer(0)));
+		m_possible_moves.Add(Move::PlayCard(c, Move::TargetPlayer(1)));
+		return;
+	case TargetType::AnyCharacter:
+	case TargetType::AnyMinion:
+		for (uint8_t player_index = 0; player_index < 2; ++player_index)
 		{
-			const auto& targets = target_map[(uint8_t)data->m_spell_data.m_target_type];
+			for (uint8_t targets = source.m_targetable[player_index]; targets; targets &= targets - 1)
+			{
+				m_possible_moves.Add(Move::PlayCard(c, Move::TargetMinion(player_index, NthSetBit(targets, 0))));
+			}
 
-			for (uint8_t target_index = 0; target_index < targets.Num( ); ++target_index)
+			if (type == TargetType::AnyCharacter)
 			{
-				m_possible_moves.Add(Move::PlayCard(c, targets[target_index]));
+				m_possible_moves.Add(Move::PlayCard(c, Move::TargetPlayer(player_index)));
 			}
 		}
-			break;
+		return;
+	}
+}
+
+// Must match the targets GeneratePossibleMoves lists
+bool GameStateCore::CanTarget(uint8_t player_index, uint8_t minion_index) const
+{
+	return player_index == m_active_player_index || !(m_players[player_index].m_minions.StealthMask( ) & (1 << minion_index));
+}
+
+// Bit per minion of the player's that CanTarget allows
+uint8_t GameStateCore::TargetableMask(uint8_t player_index) const
+{
+	const MinionBoard& board = m_players[player_index].m_minions;
+	if (player_index == m_active_player_index)
+	{
+		return board.UsedMask( );
+	}
+	return board.UsedMask( ) & ~board.StealthMask( );
+}
+
+uint8_t GameStateCore::NumTargetableMinions( ) const
+{
+	return PopCount(TargetableMask(0)) + PopCount(TargetableMask(1));
+}
+
+uint8_t GameStateCore::NumTargets(TargetType type, uint8_t num_minions) const
+{
+	switch (type)
+	{
+	case TargetType::None: return 1;
+	case TargetType::Opponent: return 1;
+	case TargetType::SelfPlayer: return 1;
+	case TargetType::AnyPlayer: return 2;
+	case TargetType::AnyCharacter: return num_minions + 2;
+	case TargetType::AnyMinion: return num_minions;
+	default: return 0;
+	}
+}
+
+PackedTarget GameStateCore::GetTarget(TargetType type, uint8_t index) const
+{
+	switch (type)
+	{
+	case TargetType::None: return Move::TargetNone( );
+	case TargetType::Opponent: return Move::TargetPlayer(OppositePlayer(m_active_player_index));
+	case TargetType::SelfPlayer: return Move::TargetPlayer(m_active_player_index);
+	case TargetType::AnyPlayer: return Move::TargetPlayer(index);
+	}
+
+	// Each player's targetable minions, followed by the player for AnyCharacter
+	for (uint8_t player_index = 0; player_index < 2; ++player_index)
+	{
+		const uint8_t targetable = TargetableMask(player_index);
+		const uint8_t num_targetable = PopCount(targetable);
+		if (index < num_targetable)
+		{
+			return Move::TargetMinion(player_index, NthSetBit(targetable, index));
+		}
+		index -= num_targetable;
+
+		if (type == TargetType::AnyCharacter && index-- == 0)
+		{
+			return Move::TargetPlayer(player_index);
 		}
 	}
+	return Move::TargetNone( );
+}
 
-	// End turn
-	m_possible_moves.Add(Move::EndTurn());
+// Bit per opponent minion that can be attacked. When one of them has taunt the opponent can't be.
+uint8_t GameStateCore::AttackTargetMask(bool& out_taunt) const
+{
+	const MinionBoard& opponent = m_players[OppositePlayer(m_active_player_index)].m_minions;
+	const uint8_t visible = opponent.UsedMask( ) & ~opponent.StealthMask( );
+	const uint8_t taunts = visible & opponent.TauntMask( );
+
+	out_taunt = taunts != 0;
+	return out_taunt ? taunts : visible;
+}
+
+uint8_t GameStateCore::NumCardMoves(Card c, uint8_t num_minions) const
+{
+	const CardData* const data = GetCardData(c);
+	if (data->m_mana_cost > m_players[m_active_player_index].m_mana)
+		return 0;
+
+	if (data->m_type == CardType::Minion)
+	{
+		// Minions can be played without a target when their battlecry has none
+		return std::max<uint8_t>(NumTargets(data->m_minion_battlecry.m_target_type, num_minions), 1);
+	}
+	return NumTargets(data->m_spell_data.m_target_type, num_minions);
+}
+
+uint16_t GameStateCore::CountPossibleMoves(PossibleMoveCounts& counts) const
+{
+	const Player& active = m_players[m_active_player_index];
+
+	counts.m_attackers = active.m_minions.CanAttackMask( );
+
+	uint16_t num_moves = 1; // End turn
+	if (counts.m_attackers)
+	{
+		counts.m_attack_targets = AttackTargetMask(counts.m_taunt);
+		counts.m_num_attack_targets = PopCount(counts.m_attack_targets) + !counts.m_taunt;
+		num_moves += PopCount(counts.m_attackers) * counts.m_num_attack_targets;
+	}
+
+	counts.m_num_minions = NumTargetableMinions( );
+	for (uint8_t i = 0; i < active.m_hand.Num( ); ++i)
+	{
+		counts.m_card_moves[i] = NumCardMoves(active.m_hand[i], counts.m_num_minions);
+		num_moves += counts.m_card_moves[i];
+	}
+	return num_moves;
+}
+
+Move GameStateCore::GetPossibleMove(uint16_t index, const PossibleMoveCounts& counts) const
+{
+	const Player& active = m_players[m_active_player_index];
+
+	// Each attacker has the same targets, so the attacker and target come straight from the index
+	const uint16_t num_attack_moves = PopCount(counts.m_attackers) * counts.m_num_attack_targets;
+	if (index < num_attack_moves)
+	{
+		uint8_t attacker = NthSetBit(counts.m_attackers, (uint8_t)(index / counts.m_num_attack_targets));
+		uint8_t target = (uint8_t)(index % counts.m_num_attack_targets);
+		if (target < PopCount(counts.m_attack_targets))
+		{
+			return Move::AttackMinion(attacker, NthSetBit(counts.m_attack_targets, target));
+		}
+		return Move::AttackHero(attacker);
+	}
+	index -= num_attack_moves;
+
+	for (uint8_t i = 0; i < active.m_hand.Num( ); ++i)
+	{
+		if (index >= counts.m_card_moves[i])
+		{
+			index -= counts.m_card_moves[i];
+			continue;
+		}
+
+		Card c = active.m_hand[i];
+		const CardData* const data = GetCardData(c);
+		TargetType target_type = data->m_type == CardType::Minion ? data->m_minion_battlecry.m_target_type : data->m_spell_data.m_target_type;
+		if (NumTargets(target_type, counts.m_num_minions) == 0)
+		{
+			return Move::PlayCard(c);
+		}
+		return Move::PlayCard(c, GetTarget(target_type, (uint8_t)index));
+	}
+
+	return Move::EndTurn( );
+}
+
+uint16_t GameStateCore::CountPossibleMoves( ) const
+{
+	PossibleMoveCounts counts;
+	return CountPossibleMoves(counts);
+}
+
+Move GameStateCore::GetPossibleMove(uint16_t index) const
+{
+	PossibleMoveCounts counts;
+	CountPossibleMoves(counts);
+	return GetPossibleMove(index, counts);
 }
 
-void GameState::EndTurn()
+void GameStateCore::EndTurn()
 {
+	Journal(m_active_player_index);
 	m_active_player_index = (uint8_t)abs(m_active_player_index - 1);
+	HashActivePlayer( );
 	Player& ActivePlayer = m_players[m_active_player_index];
-	ActivePlayer.DrawOne();
+	Journal(ActivePlayer.m_hand);
+	Journal(ActivePlayer.m_deck);
+	Journal(ActivePlayer.m_max_mana);
+	Journal(ActivePlayer.m_mana);
+	DrawOne(m_active_player_index);
+	HashMaxMana(m_active_player_index);
+	HashMana(m_active_player_index);
 	ActivePlayer.m_max_mana = (uint8_t)std::min(10, ActivePlayer.m_max_mana + 1);
 	ActivePlayer.m_mana = ActivePlayer.m_max_mana;
+	HashMaxMana(m_active_player_index);
+	HashMana(m_active_player_index);
 
 	for (uint8_t player_idx = 0; player_idx < 2; ++player_idx)
 	{
+		Journal(m_players[player_idx].m_minions);
 		for (uint8_t i = 0; i < m_players[player_idx].m_minions.Num( ); ++i)
 		{
-			Minion& m = m_players[player_idx].m_minions[i];
+			MinionRef m = m_players[player_idx].m_minions[i];
+			HashMinion(player_idx, i);
 			m.ClearAttackFlags( );
 			m.RemoveEndOfTurnAuras( );
+			HashMinion(player_idx, i);
 		}
 	}
 
 	// HACK before fatigue goes in
 	if (m_players[0].m_deck.Num() == 0 && m_players[1].m_deck.Num() == 0)
 	{
+		Journal(m_winner);
 		m_winner = Winner::Draw;
 	}
 }
 
-void GameState::PlayCard(Card c, PackedTarget packed_target)
+void GameStateCore::PlayCard(Card c, PackedTarget packed_target)
 {
 	Player& ToAct = m_players[m_active_player_index];
 	const CardData* ToPlay = GetCardData(c);
@@ -238,9 +677,14 @@ void GameState::PlayCard(Card c, PackedTarget packed_target)
 	if (!ToAct.m_hand.Find(c, idx))
 		return;
 
+	Journal(ToAct.m_hand);
 	ToAct.m_hand.RemoveSwap(idx);
+	HashHandCard(m_active_player_index, c);
 
+	Journal(ToAct.m_mana);
+	HashMana(m_active_player_index);
 	ToAct.m_mana -= ToPlay->m_mana_cost;
+	HashMana(m_active_player_index);
 
 	if (ToPlay->m_type == CardType::Minion)
 	{
@@ -252,49 +696,64 @@ void GameState::PlayCard(Card c, PackedTarget packed_target)
 	}
 }
 
-void GameState::AttackHero(uint8_t SourceIndex)
+void GameStateCore::AttackHero(uint8_t SourceIndex)
 {
 	Player& Active = m_players[m_active_player_index];
 	Player& Opponent = m_players[abs(m_active_player_index - 1)];
 
-	Minion& Attacker = Active.m_minions[SourceIndex];
+	uint8_t opponent_index = OppositePlayer(m_active_player_index);
+
+	MinionRef Attacker = Active.m_minions[SourceIndex];
+	Journal(Active.m_minions);
+	HashMinion(m_active_player_index, SourceIndex);
 	Attacker.Attacked( );
+	HashMinion(m_active_player_index, SourceIndex);
 
+	Journal(Opponent.m_health);
+	HashHealth(opponent_index);
 	Opponent.m_health -= Attacker.m_attack;
+	HashHealth(opponent_index);
 
 	if (Opponent.m_health <= 0)
 	{
+		Journal(m_winner);
 		m_winner = static_cast<Winner>(m_active_player_index);
 	}
 }
 
-void GameState::CheckDeadMinion(uint8_t player_index, uint8_t minion_index)
+void GameStateCore::CheckDeadMinion(uint8_t player_index, uint8_t minion_index)
 {
 	Player& owner = m_players[player_index];
-	Minion& dead_minion = owner.m_minions[minion_index];
-	if (dead_minion.m_health <= 0)
+	if (owner.m_minions.m_health[minion_index] <= 0)
 	{
-		if (dead_minion.HasDeathrattle())
-		{
-			PushDeathrattle(player_index, dead_minion);
-		}
+		PushDeathrattle(player_index, owner.m_minions.m_source_card[minion_index]);
+		Journal(owner.m_minions);
+		HashMinions(player_index);
 		owner.m_minions.RemoveAt(minion_index);
+		HashMinions(player_index);
 	}
 }
 
-void GameState::AttackMinion(uint8_t SourceIndex, uint8_t TargetIndex)
+void GameStateCore::AttackMinion(uint8_t SourceIndex, uint8_t TargetIndex)
 {
 	Player& Active = m_players[m_active_player_index];
 	Player& Opponent = m_players[OppositePlayer(m_active_player_index)];
 
-	Minion& Attacker = Active.m_minions[SourceIndex];
-	Minion& Victim = Opponent.m_minions[TargetIndex];
+	MinionRef Attacker = Active.m_minions[SourceIndex];
+	MinionRef Victim = Opponent.m_minions[TargetIndex];
+	Journal(Active.m_minions);
+	Journal(Opponent.m_minions);
+	HashMinion(m_active_player_index, SourceIndex);
+	HashMinion(OppositePlayer(m_active_player_index), TargetIndex);
 
 	Attacker.TakeDamage(Victim.m_attack);
 	Victim.TakeDamage(Attacker.m_attack);
 
 	Attacker.Attacked( );
 
+	HashMinion(m_active_player_index, SourceIndex);
+	HashMinion(OppositePlayer(m_active_player_index), TargetIndex);
+
 	// Handle minion death
 	// TODO: Refactor when handling simultaneous minion death
 	CheckDeadMinion(m_active_player_index, SourceIndex);
@@ -303,7 +762,7 @@ void GameState::AttackMinion(uint8_t SourceIndex, uint8_t TargetIndex)
 	CheckVictory( );
 }
 
-void GameState::HandlePendingSpellEffect(const SpellData& data, uint8_t owner_index)
+void GameStateCore::HandlePendingSpellEffect(const SpellData& data, uint8_t owner_index)
 {
 	uint8_t opponent_index = OppositePlayer(owner_index);
 	PackedTarget target = Move::TargetNone();
@@ -319,7 +778,7 @@ void GameState::HandlePendingSpellEffect(const SpellData& data, uint8_t owner_in
 	HandleSpell(data, target, owner_index);
 }
 
-void GameState::HandleSpell(const SpellData& spell_data, PackedTarget target_packed, uint8_t owner_index, bool affected_by_spelldamage)
+void GameStateCore::HandleSpell(const SpellData& spell_data, PackedTarget target_packed, uint8_t owner_index, bool affected_by_spelldamage)
 {
 	uint8_t target_player, target_minion;
 	Move::UnpackTarget(target_packed, target_player, target_minion);
@@ -329,21 +788,29 @@ void GameState::HandleSpell(const SpellData& spell_data, PackedTarget target_pac
 	case SpellEffect::AddMana:
 	{
 		Player& p = m_players[target_player];
+		Journal(p.m_mana);
+		HashMana(target_player);
 		p.m_mana += spell_data.m_param;
+		HashMana(target_player);
 	}
 	break;
 	case SpellEffect::AddManaCrystal:
 	{
 		Player& p = m_players[target_player];
+		Journal(p.m_max_mana);
+		HashMaxMana(target_player);
 		p.m_max_mana += spell_data.m_param;
+		HashMaxMana(target_player);
 	}
 	break;
 	case SpellEffect::DrawCard:
 	{
 		Player& p = m_players[target_player];
+		Journal(p.m_hand);
+		Journal(p.m_deck);
 		for (uint8_t i = 0; i < spell_data.m_param; ++i)
 		{
-			p.DrawOne( );
+			DrawOne(target_player);
 		}
 	}
 	break;
@@ -352,13 +819,22 @@ void GameState::HandleSpell(const SpellData& spell_data, PackedTarget target_pac
 		uint8_t dmg = spell_data.m_param + spelldamage;
 		if (spell_data.m_target_type == TargetType::AllMinions)
 		{
-			ForEachMinion([=](Minion& m){ m.m_health -= dmg; });
+			JournalMinions( );
+			HashBoard( );
+			ForEachBoard([=](MinionBoard& b){ b.DamageAll(dmg); });
+			HashBoard( );
 			CheckDeadMinions( );
 		}
 		else if (spell_data.m_target_type == TargetType::AllCharacters)
 		{
+			JournalHealth( );
+			JournalMinions( );
+			HashAllHealth( );
+			HashBoard( );
 			ForEachPlayer([=](Player& p){ p.m_health -= dmg; });
-			ForEachMinion([=](Minion& m){ m.m_health -= dmg; });
+			ForEachBoard([=](MinionBoard& b){ b.DamageAll(dmg); });
+			HashAllHealth( );
+			HashBoard( );
 			CheckDeadMinions( );
 		}
 		else if (spell_data.m_target_type == TargetType::AllFriendlyCharacters)
@@ -368,11 +844,17 @@ void GameState::HandleSpell(const SpellData& spell_data, PackedTarget target_pac
 		else if (target_minion == NoMinion)
 		{
 			// Target hero
+			Journal(m_players[target_player].m_health);
+			HashHealth(target_player);
 			m_players[target_player].m_health -= dmg;
+			HashHealth(target_player);
 		}
 		else
 		{
-			m_players[target_player].m_minions[target_minion].m_health -= dmg;
+			Journal(m_players[target_player].m_minions);
+			HashMinion(target_player, target_minion);
+			m_players[target_player].m_minions.m_health[target_minion] -= dmg;
+			HashMinion(target_player, target_minion);
 			CheckDeadMinion(target_player, target_minion);
 		}
 
@@ -384,46 +866,76 @@ void GameState::HandleSpell(const SpellData& spell_data, PackedTarget target_pac
 		uint8_t amt = spell_data.m_param + spelldamage;
 		if (spell_data.m_target_type == TargetType::AllMinions)
 		{
-			ForEachMinion([=](Minion& m){ m.Heal(amt); });
+			JournalMinions( );
+			HashBoard( );
+			ForEachBoard([=](MinionBoard& b){ b.HealAll(amt); });
+			HashBoard( );
 			CheckDeadMinions( );
 		}
 		else if (spell_data.m_target_type == TargetType::AllCharacters)
 		{
+			JournalHealth( );
+			JournalMinions( );
+			HashAllHealth( );
+			HashBoard( );
 			ForEachPlayer([=](Player& p){ p.Heal(amt); });
-			ForEachMinion([=](Minion& m){ m.Heal(amt); });
+			ForEachBoard([=](MinionBoard& b){ b.HealAll(amt); });
+			HashAllHealth( );
+			HashBoard( );
 			CheckDeadMinions( );
 		}
 		else if (spell_data.m_target_type == TargetType::AllFriendlyCharacters)
 		{
+			Journal(m_players[owner_index].m_health);
+			Journal(m_players[owner_index].m_minions);
+			HashHealth(owner_index);
+			HashMinions(owner_index);
 			m_players[owner_index].Heal(amt);
-			ForEachMinion(owner_index, [=](Minion& m){ m.Heal(amt); });
+			m_players[owner_index].m_minions.HealAll(amt);
+			HashHealth(owner_index);
+			HashMinions(owner_index);
 		}
 		else if (target_minion == NoMinion)
 		{
+			Journal(m_players[target_player].m_health);
+			HashHealth(target_player);
 			m_players[target_player].Heal(spell_data.m_param);
+			HashHealth(target_player);
 		}
 		else
 		{
+			Journal(m_players[target_player].m_minions);
+			HashMinion(target_player, target_minion);
 			m_players[target_player].m_minions[target_minion].Heal(spell_data.m_param);
+			HashMinion(target_player, target_minion);
 		}
 	}
 		break;
 	case SpellEffect::SetHealth:
 	{
+		Journal(m_players[target_player].m_health);
+		HashHealth(target_player);
 		m_players[target_player].m_health = spell_data.m_param;
+		HashHealth(target_player);
 	}
 		break;
 	case SpellEffect::AddMinionAura:
 	{
-		Minion& m = m_players[target_player].m_minions[target_minion];
-		m.m_auras.Add(spell_data.m_aura);
-		m.AddAuraEffects(spell_data.m_aura);
+		// Minion battlecries can be played without a target when there are no minions
+		if (target_minion == NoMinion)
+			break;
+
+		MinionRef m = m_players[target_player].m_minions[target_minion];
+		Journal(m_players[target_player].m_minions);
+		HashMinion(target_player, target_minion);
+		m.AddAura(spell_data.m_aura);
+		HashMinion(target_player, target_minion);
 	}
 		break;
 	}
 }
 
-void GameState::PlayMinion(Card c, PackedTarget target_packed)
+void GameStateCore::PlayMinion(Card c, PackedTarget target_packed)
 {
 	const CardData* data = GetCardData(c);
 
@@ -432,11 +944,18 @@ void GameState::PlayMinion(Card c, PackedTarget target_packed)
 		HandleSpell(data->m_minion_battlecry, target_packed, m_active_player_index);
 	}
 
-	m_players[m_active_player_index].m_minions.Add({ data });
+	auto& minions = m_players[m_active_player_index].m_minions;
+	Journal(minions);
+	auto minion_index = minions.Add({ data });
+	if (minion_index != minions.Capacity)
+	{
+		HashMinion(m_active_player_index, minion_index);
+	}
 }
 
-void GameState::CheckVictory( )
+void GameStateCore::CheckVictory( )
 {
+	Journal(m_winner);
 	if (m_players[0].m_health <= 0 && m_players[1].m_health <= 0)
 	{
 		m_winner = Winner::Draw;
@@ -451,35 +970,42 @@ void GameState::CheckVictory( )
 	}
 }
 
-void GameState::CheckDeadMinions( )
+void GameStateCore::CheckDeadMinions( )
 {
 	for (uint8_t player_idx = 0; player_idx < 2; ++player_idx)
 	{
-		if (m_players[player_idx].m_minions.Num( ))
+		MinionBoard& board = m_players[player_idx].m_minions;
+		uint8_t dead = board.DeadMask( );
+		if (dead == 0)
+			continue;
+
+		// Deathrattles go off from the right of the board
+		for (uint8_t minion_idx = board.Num( ) - 1;; --minion_idx)
 		{
-			for (uint8_t minion_idx = m_players[player_idx].m_minions.Num( ) - 1;; --minion_idx)
+			if (dead & (1 << minion_idx))
 			{
-				if (m_players[player_idx].m_minions[minion_idx].m_health <= 0)
-				{
-					PushDeathrattle(player_idx, m_players[player_idx].m_minions[minion_idx]);
-					m_players[player_idx].m_minions.RemoveAt(minion_idx);
-				}
-				if (minion_idx == 0)
-					break;
+				PushDeathrattle(player_idx, board.m_source_card[minion_idx]);
 			}
+			if (minion_idx == 0)
+				break;
 		}
+
+		Journal(board);
+		HashMinions(player_idx);
+		board.RemoveMask(dead);
+		HashMinions(player_idx);
 	}
 }
 
-void GameState::PushDeathrattle(uint8_t owner_idx, const Minion& m)
+void GameStateCore::PushDeathrattle(uint8_t owner_idx, Card source_card)
 {
-	if (m.HasDeathrattle( ))
+	if (GetCardData(source_card)->m_minion_deathrattle.m_effect != SpellEffect::None)
 	{
-		m_pending_spell_effects.Add({ m.m_source_card->m_minion_deathrattle, owner_idx });
+		m_pending_spell_effects.Add({ source_card, owner_idx });
 	}
 }
 
-void GameState::PrintMove(const Move& m) const
+void GameStateCore::PrintMove(const Move& m) const
 {
 	const Player& Active = m_players[m_active_player_index];
 	const Player& Opponent = m_players[abs(m_active_player_index - 1)];
@@ -510,7 +1036,7 @@ void GameState::PrintMove(const Move& m) const
 	}
 }
 
-void GameState::PrintState() const
+void GameStateCore::PrintState() const
 {
 	for (unsigned i = 0; i < 2; ++i)
 	{
@@ -530,8 +1056,3 @@ void GameState::PrintState() const
 		}
 	}
 }
-
-const char* Minion::GetName() const
-{
-	return m_source_card->m_name;
-}
\ No newline at end of file
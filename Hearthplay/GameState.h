@@ -2,8 +2,11 @@
 
 #include "Cards.h"
 #include "FixedVector.h"
+#include "UndoJournal.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <random>
 #include <utility>
 
@@ -17,7 +20,7 @@ enum class Winner : int8_t
 	Draw = 2
 };
 
-enum class MoveType
+enum class MoveType : uint8_t
 {
 	EndTurn,
 	AttackMinion,
@@ -37,7 +40,7 @@ struct PackedTarget
 
 	inline bool operator<(const PackedTarget& other) const
 	{
-		return m_player < other.m_player || m_minion < other.m_minion;
+		return m_player < other.m_player || (m_player == other.m_player && m_minion < other.m_minion);
 	}
 };
 
@@ -64,6 +67,16 @@ struct Move
 			&& m_card == m.m_card;
 	}
 
+	// All of the move in one integer, ordered by type, source, target and then card
+	inline uint32_t Packed( ) const
+	{
+		return (uint32_t)m_type << 24
+			| (uint32_t)m_source_index << 16
+			| (uint32_t)m_target_packed.m_player << 12
+			| (uint32_t)m_target_packed.m_minion << 8
+			| (uint32_t)m_card;
+	}
+
 	static Move AttackHero(uint8_t with_minion)
 	{
 		return Move{ MoveType::AttackHero, with_minion, TargetNone(), Card::MAX };
@@ -121,16 +134,7 @@ protected:
 
 inline bool operator<(const Move& l, const Move& r)
 {
-	if (l.m_type == r.m_type)
-	{
-		if (l.m_source_index == r.m_source_index)
-		{
-			return l.m_target_packed < r.m_target_packed;
-		}
-		return l.m_source_index < r.m_source_index;
-	}
-
-	return l.m_type < r.m_type;
+	return l.Packed( ) < r.Packed( );
 }
 
 enum class MinionFlags : uint8_t
@@ -143,58 +147,36 @@ enum class MinionFlags : uint8_t
 
 IMPLEMENT_FLAGS(MinionFlags, uint8_t);
 
-struct Minion
-{
-	static const uint8_t MaxAuras = 10; // TODO: What is a reasonable max?
-
-	uint8_t				m_attack;
-	int8_t				m_health, m_max_health;
-	uint8_t				m_spelldamage;
-	const CardData*		m_source_card;
-	MinionAbilityFlags	m_abilities;
-	MinionFlags			m_flags;
-	FixedVector<MinionAura, MaxAuras, uint8_t> m_auras;
-
-	Minion( )
-		: m_attack(0)
-		, m_health(0)
-		, m_max_health(0)
-		, m_spelldamage(0)
-		, m_source_card(nullptr)
-		, m_abilities(MinionAbilityFlags::None)
-		, m_flags(MinionFlags::None)
-	{
-		
-	}
-
-	Minion(const CardData* source_card)
-		: m_attack(source_card->m_attack)
-		, m_health(source_card->m_health)
-		, m_max_health(source_card->m_health)
-		, m_spelldamage(source_card->m_minion_spelldamage)
-		, m_source_card(source_card)
-		, m_flags(MinionFlags::SummonedThisTurn)
-		, m_abilities(source_card->m_minion_abilities)
-	{
-	}
+// Aura totals: auras are only ever added up and taken off again, so rather than a list a minion keeps the
+// total of each effect for each duration, with no slot for the None effect or duration.
+static const uint8_t NumAuraEffects = (uint8_t)MinionAuraEffect::MAX - 1;
+static const uint8_t NumAuraDurations = (uint8_t)AuraDuration::MAX - 1;
+typedef uint8_t MinionAuraTotals[NumAuraDurations][NumAuraEffects];
 
+// The rules for a single minion. Shared by Minion, which holds its own fields, and MinionRef, whose fields
+// are references into a MinionBoard, so both can be used the same way.
+template<typename Derived>
+struct MinionRules
+{
 	inline void ClearAttackFlags()
 	{
-		m_flags &= ~( MinionFlags::AttackedThisTurn 
+		Self( ).m_flags &= ~( MinionFlags::AttackedThisTurn 
 				|	MinionFlags::WindfuryAttackedThisTurn
 				|	MinionFlags::SummonedThisTurn
 			);
+		Self( ).StatusChanged( );
 	}
 
 	inline void Attacked( )
 	{
 		if (AttackedThisTurn( ))
 		{
-			m_flags |= MinionFlags::WindfuryAttackedThisTurn;
+			Self( ).m_flags |= MinionFlags::WindfuryAttackedThisTurn;
 		}
 
-		m_flags |= MinionFlags::AttackedThisTurn;
-		RemoveStealth( );
+		Self( ).m_flags |= MinionFlags::AttackedThisTurn;
+		Self( ).m_abilities &= ~MinionAbilityFlags::Stealth;
+		Self( ).StatusChanged( );
 	}
 
 	inline void TakeDamage(uint8_t damage)
@@ -205,15 +187,23 @@ struct Minion
 		}
 		else
 		{
-			m_health -= damage;
+			Self( ).m_health -= damage;
 		}
 	}
 
-	const char* GetName() const;
+	inline const CardData* GetSourceCardData( ) const
+	{
+		return GetCardData(Self( ).m_source_card);
+	}
+
+	inline const char* GetName() const
+	{
+		return GetSourceCardData( )->m_name;
+	}
 
-	inline bool CanAttack( )
+	inline bool CanAttack( ) const
 	{
-		return !HasFlag(m_abilities, MinionAbilityFlags::CannotAttack)
+		return !HasFlag(Self( ).m_abilities, MinionAbilityFlags::CannotAttack)
 			&& (!SummonedThisTurn() || HasCharge())
 			&& ((!WindfuryAttackedThisTurn() && HasWindfury())
 			|| !AttackedThisTurn()
@@ -222,77 +212,528 @@ struct Minion
 
 	inline bool AttackedThisTurn( ) const
 	{
-		return HasFlag(m_flags, MinionFlags::AttackedThisTurn);
+		return HasFlag(Self( ).m_flags, MinionFlags::AttackedThisTurn);
 	}
 
 	inline bool WindfuryAttackedThisTurn( ) const
 	{
-		return HasFlag(m_flags, MinionFlags::WindfuryAttackedThisTurn);
+		return HasFlag(Self( ).m_flags, MinionFlags::WindfuryAttackedThisTurn);
 	}
 
 	inline bool SummonedThisTurn( ) const
 	{
-		return HasFlag(m_flags, MinionFlags::SummonedThisTurn);
+		return HasFlag(Self( ).m_flags, MinionFlags::SummonedThisTurn);
 	}
 
 	inline bool HasCharge( ) const
 	{
-		return HasFlag(m_abilities, MinionAbilityFlags::Charge);
+		return HasFlag(Self( ).m_abilities, MinionAbilityFlags::Charge);
 	}
 
 	inline bool HasDivineShield( ) const
 	{
-		return HasFlag(m_abilities, MinionAbilityFlags::DivineShield);
+		return HasFlag(Self( ).m_abilities, MinionAbilityFlags::DivineShield);
 	}
 
 	inline void RemoveDivineShield( )
 	{
-		m_abilities &= ~MinionAbilityFlags::DivineShield;
+		Self( ).m_abilities &= ~MinionAbilityFlags::DivineShield;
+		Self( ).StatusChanged( );
 	}
 
 	inline bool HasWindfury( ) const
 	{
-		return HasFlag(m_abilities, MinionAbilityFlags::Windfury);
+		return HasFlag(Self( ).m_abilities, MinionAbilityFlags::Windfury);
 	}
 
 	inline bool HasTaunt( ) const
 	{
-		return HasFlag(m_abilities, MinionAbilityFlags::Taunt);
+		return HasFlag(Self( ).m_abilities, MinionAbilityFlags::Taunt);
 	}
 
 	inline bool HasStealth( ) const
 	{
-		return HasFlag(m_abilities, MinionAbilityFlags::Stealth);
+		return HasFlag(Self( ).m_abilities, MinionAbilityFlags::Stealth);
 	}
 
 	inline void RemoveStealth( )
 	{
-		m_abilities &= ~MinionAbilityFlags::Stealth;
+		Self( ).m_abilities &= ~MinionAbilityFlags::Stealth;
+		Self( ).StatusChanged( );
 	}
 
 	inline void AddAbility( MinionAbilityFlags ability )
 	{
-		m_abilities |= ability;
+		Self( ).m_abilities |= ability;
+		Self( ).StatusChanged( );
 	}
 
 	inline bool HasDeathrattle( ) const
 	{
-		return m_source_card->m_minion_deathrattle.m_effect != SpellEffect::None;
+		return GetSourceCardData( )->m_minion_deathrattle.m_effect != SpellEffect::None;
 	}
 
-	inline void Heal( uint8_t amt );
-	void AddAuraEffects(const MinionAura& aura);
-	void RemoveAuraEffects(const MinionAura& aura);
-	void RemoveEndOfTurnAuras( );
+	inline uint8_t& AuraTotal(AuraDuration duration, MinionAuraEffect effect)
+	{
+		return Self( ).m_aura_totals[(uint8_t)duration - 1][(uint8_t)effect - 1];
+	}
+
+	inline uint8_t AuraTotal(AuraDuration duration, MinionAuraEffect effect) const
+	{
+		return Self( ).m_aura_totals[(uint8_t)duration - 1][(uint8_t)effect - 1];
+	}
+
+	inline void Heal( uint8_t amt )
+	{
+		Self( ).m_health = std::min<int8_t>(Self( ).m_health + amt, Self( ).m_max_health);
+	}
+
+	inline void AddAura(const MinionAura& aura)
+	{
+		if (aura.m_effect == MinionAuraEffect::None || aura.m_duration == AuraDuration::None)
+			return;
+
+		AuraTotal(aura.m_duration, aura.m_effect) += aura.m_param;
+		AddAuraEffects(aura);
+	}
+
+	inline void AddAuraEffects(const MinionAura& aura)
+	{
+		switch (aura.m_effect)
+		{
+		case MinionAuraEffect::BonusAttack:
+			Self( ).m_attack += aura.m_param;
+			break;
+		}
+	}
+
+	inline void RemoveAuraEffects(const MinionAura& aura)
+	{
+		switch (aura.m_effect)
+		{
+		case MinionAuraEffect::BonusAttack:
+			Self( ).m_attack -= aura.m_param;
+			break;
+		}
+	}
+
+	inline void RemoveEndOfTurnAuras( )
+	{
+		for (uint8_t effect = 1; effect <= NumAuraEffects; ++effect)
+		{
+			uint8_t& total = AuraTotal(AuraDuration::EndOfTurn, (MinionAuraEffect)effect);
+			if (total)
+			{
+				RemoveAuraEffects(MinionAura((MinionAuraEffect)effect, total, AuraDuration::EndOfTurn));
+				total = 0;
+			}
+		}
+	}
+
+private:
+	inline Derived& Self( )
+	{
+		return *static_cast<Derived*>(this);
+	}
+
+	inline const Derived& Self( ) const
+	{
+		return *static_cast<const Derived*>(this);
+	}
+};
+
+// A minion on its own, for putting on the board and for reading one back off it
+struct Minion : public MinionRules<Minion>
+{
+	uint8_t				m_attack;
+	int8_t				m_health, m_max_health;
+	uint8_t				m_spelldamage;
+	Card				m_source_card;
+	MinionAbilityFlags	m_abilities;
+	MinionFlags			m_flags;
+	MinionAuraTotals	m_aura_totals;
+
+	Minion( )
+		: m_attack(0)
+		, m_health(0)
+		, m_max_health(0)
+		, m_spelldamage(0)
+		, m_source_card(Card::MAX)
+		, m_abilities(MinionAbilityFlags::None)
+		, m_flags(MinionFlags::None)
+		, m_aura_totals()
+	{
+		
+	}
+
+	Minion(Card source_card)
+		: Minion(GetCardData(source_card))
+	{
+	}
+
+	Minion(const CardData* source_card)
+		: m_attack(source_card->m_attack)
+		, m_health(source_card->m_health)
+		, m_max_health(source_card->m_health)
+		, m_spelldamage(source_card->m_minion_spelldamage)
+		, m_source_card(GetCard(source_card))
+		, m_abilities(source_card->m_minion_abilities)
+		, m_flags(MinionFlags::SummonedThisTurn)
+		, m_aura_totals()
+	{
+	}
+
+	// Nothing is derived from a lone minion's abilities and flags
+	inline void StatusChanged( )
+	{
+	}
+};
+
+class MinionBoard;
+
+// A minion in a MinionBoard, which reads and writes the board's arrays as if it were a Minion&
+struct MinionRef : public MinionRules<MinionRef>
+{
+	uint8_t&			m_attack;
+	int8_t&				m_health;
+	int8_t&				m_max_health;
+	uint8_t&			m_spelldamage;
+	Card&				m_source_card;
+	MinionAbilityFlags&	m_abilities;
+	MinionFlags&		m_flags;
+	MinionAuraTotals&	m_aura_totals;
+
+	inline MinionRef(MinionBoard& board, uint8_t index);
+
+	// Brings the board's masks up to date after the abilities or flags change
+	inline void StatusChanged( );
+
+	inline MinionRef& operator=(const Minion& m)
+	{
+		m_attack = m.m_attack;
+		m_health = m.m_health;
+		m_max_health = m.m_max_health;
+		m_spelldamage = m.m_spelldamage;
+		m_source_card = m.m_source_card;
+		m_abilities = m.m_abilities;
+		m_flags = m.m_flags;
+		memcpy(m_aura_totals, m.m_aura_totals, sizeof(m_aura_totals));
+		return *this;
+	}
+
+private:
+	MinionBoard&		m_board;
+	uint8_t				m_index;
+};
+
+inline uint8_t PopCount(uint8_t bits)
+{
+	bits = bits - ((bits >> 1) & 0x55);
+	bits = (bits & 0x33) + ((bits >> 2) & 0x33);
+	return (bits + (bits >> 4)) & 0x0F;
+}
+
+// Whether MinionRules::CanAttack would allow a minion with these abilities and flags to attack
+inline bool CanAttack(MinionAbilityFlags abilities, MinionFlags flags)
+{
+	const uint8_t a = (uint8_t)abilities;
+	const uint8_t f = (uint8_t)flags;
+	const bool not_prevented = (a & (uint8_t)MinionAbilityFlags::CannotAttack) == 0;
+	const bool ready = (f & (uint8_t)MinionFlags::SummonedThisTurn) == 0 || (a & (uint8_t)MinionAbilityFlags::Charge) != 0;
+	const bool has_attack = (f & (uint8_t)MinionFlags::AttackedThisTurn) == 0
+		|| ((f & (uint8_t)MinionFlags::WindfuryAttackedThisTurn) == 0 && (a & (uint8_t)MinionAbilityFlags::Windfury) != 0);
+	return not_prevented & ready & has_attack;
+}
+
+// Index of the nth set bit, counting from the lowest. There must be more than n bits set.
+inline uint8_t NthSetBit(uint8_t bits, uint8_t n)
+{
+	for (; n; --n)
+	{
+		bits &= bits - 1;
+	}
+
+	uint8_t index = 0;
+	while (!(bits & 1))
+	{
+		bits >>= 1;
+		++index;
+	}
+	return index;
+}
+
+// A player's minions as parallel arrays, one per field, so whole board operations are simple loops
+// over contiguous bytes. The arrays are padded to a fixed width and those loops run over all of it;
+// slots past Num are unused and can hold anything.
+//
+// The masks move generation needs, and the total spell damage, are kept alongside the arrays and updated
+// as minions are added, removed or changed through MinionRef. After writing the arrays directly call Refresh.
+class MinionBoard
+{
+public:
+	typedef uint8_t SizeType;
+	static const SizeType Capacity = 7;
+	static const SizeType Width = 8;
+
+	uint8_t				m_attack[Width];
+	int8_t				m_health[Width];
+	int8_t				m_max_health[Width];
+	uint8_t				m_spelldamage[Width];
+	Card				m_source_card[Width];
+	MinionAbilityFlags	m_abilities[Width];
+	MinionFlags			m_flags[Width];
+	MinionAuraTotals	m_aura_totals[Width];
+
+private:
+	SizeType			m_size;
+	uint8_t				m_taunt_mask;
+	uint8_t				m_stealth_mask;
+	uint8_t				m_divine_shield_mask;
+	uint8_t				m_can_attack_mask;
+	uint8_t				m_total_spelldamage;
+
+public:
+	MinionBoard( )
+		: m_size(0)
+		, m_taunt_mask(0)
+		, m_stealth_mask(0)
+		, m_divine_shield_mask(0)
+		, m_can_attack_mask(0)
+		, m_total_spelldamage(0)
+	{
+	}
+
+	inline SizeType Num( ) const
+	{
+		return m_size;
+	}
+
+	inline MinionRef operator[](SizeType index)
+	{
+		return MinionRef(*this, index);
+	}
+
+	inline Minion operator[](SizeType index) const
+	{
+		Minion m;
+		m.m_attack = m_attack[index];
+		m.m_health = m_health[index];
+		m.m_max_health = m_max_health[index];
+		m.m_spelldamage = m_spelldamage[index];
+		m.m_source_card = m_source_card[index];
+		m.m_abilities = m_abilities[index];
+		m.m_flags = m_flags[index];
+		memcpy(m.m_aura_totals, m_aura_totals[index], sizeof(m.m_aura_totals));
+		return m;
+	}
+
+	// Returns the index of the new minion, or Capacity if the board was full
+	inline SizeType Add(const Minion& m)
+	{
+		if (m_size == Capacity)
+		{
+			return m_size;
+		}
+		(*this)[m_size] = m;
+		m_total_spelldamage += m.m_spelldamage;
+		RefreshSlot(m_size);
+		return m_size++;
+	}
+
+	inline void Clear( )
+	{
+		m_size = 0;
+		m_taunt_mask = m_stealth_mask = m_divine_shield_mask = m_can_attack_mask = 0;
+		m_total_spelldamage = 0;
+	}
+
+	inline void RemoveAt(SizeType index)
+	{
+		RemoveMask((uint8_t)(1 << index));
+	}
+
+	// Remove every minion with its bit set, keeping the rest in order
+	void RemoveMask(uint8_t mask)
+	{
+		uint8_t taunt = 0, stealth = 0, divine_shield = 0, can_attack = 0;
+		SizeType to = 0;
+		for (SizeType from = 0; from < m_size; ++from)
+		{
+			const uint8_t keep = ((mask >> from) & 1) ^ 1;
+			taunt |= ((m_taunt_mask >> from) & keep) << to;
+			stealth |= ((m_stealth_mask >> from) & keep) << to;
+			divine_shield |= ((m_divine_shield_mask >> from) & keep) << to;
+			can_attack |= ((m_can_attack_mask >> from) & keep) << to;
+			m_total_spelldamage -= keep ? 0 : m_spelldamage[from];
+
+			m_attack[to] = m_attack[from];
+			m_health[to] = m_health[from];
+			m_max_health[to] = m_max_health[from];
+			m_spelldamage[to] = m_spelldamage[from];
+			m_source_card[to] = m_source_card[from];
+			m_abilities[to] = m_abilities[from];
+			m_flags[to] = m_flags[from];
+			memcpy(m_aura_totals[to], m_aura_totals[from], sizeof(MinionAuraTotals));
+			to += keep;
+		}
+		m_size = to;
+		m_taunt_mask = taunt;
+		m_stealth_mask = stealth;
+		m_divine_shield_mask = divine_shield;
+		m_can_attack_mask = can_attack;
+	}
+
+	// Recompute one minion's bits in the masks from its abilities and flags
+	inline void RefreshSlot(SizeType index)
+	{
+		const uint8_t bit = (uint8_t)(1 << index);
+		const MinionAbilityFlags abilities = m_abilities[index];
+		m_taunt_mask = (m_taunt_mask & ~bit) | (HasFlag(abilities, MinionAbilityFlags::Taunt) ? bit : 0);
+		m_stealth_mask = (m_stealth_mask & ~bit) | (HasFlag(abilities, MinionAbilityFlags::Stealth) ? bit : 0);
+		m_divine_shield_mask = (m_divine_shield_mask & ~bit) | (HasFlag(abilities, MinionAbilityFlags::DivineShield) ? bit : 0);
+		m_can_attack_mask = (m_can_attack_mask & ~bit) | (::CanAttack(abilities, m_flags[index]) ? bit : 0);
+	}
+
+	// Recompute the masks and total spell damage from the arrays
+	inline void Refresh( )
+	{
+		m_taunt_mask = AbilityMask(MinionAbilityFlags::Taunt);
+		m_stealth_mask = AbilityMask(MinionAbilityFlags::Stealth);
+		m_divine_shield_mask = AbilityMask(MinionAbilityFlags::DivineShield);
+		m_can_attack_mask = ComputeCanAttackMask( );
+		m_total_spelldamage = ComputeTotalSpelldamage( );
+	}
+
+	// Whether the masks and total spell damage agree with the arrays, for checking in debug builds
+	inline bool CachesMatch( ) const
+	{
+		return m_taunt_mask == AbilityMask(MinionAbilityFlags::Taunt)
+			&& m_stealth_mask == AbilityMask(MinionAbilityFlags::Stealth)
+			&& m_divine_shield_mask == AbilityMask(MinionAbilityFlags::DivineShield)
+			&& m_can_attack_mask == ComputeCanAttackMask( )
+			&& m_total_spelldamage == ComputeTotalSpelldamage( );
+	}
+
+	inline uint8_t TauntMask( ) const
+	{
+		return m_taunt_mask;
+	}
+
+	inline uint8_t StealthMask( ) const
+	{
+		return m_stealth_mask;
+	}
+
+	inline uint8_t DivineShieldMask( ) const
+	{
+		return m_divine_shield_mask;
+	}
+
+	// Bit per minion that MinionRules::CanAttack would allow to attack
+	inline uint8_t CanAttackMask( ) const
+	{
+		return m_can_attack_mask;
+	}
+
+	inline uint8_t TotalSpelldamage( ) const
+	{
+		return m_total_spelldamage;
+	}
+
+	// Bit per minion on the board
+	inline uint8_t UsedMask( ) const
+	{
+		return (uint8_t)((1 << m_size) - 1);
+	}
+
+	// Bit per minion with no health left
+	inline uint8_t DeadMask( ) const
+	{
+		uint8_t mask = 0;
+		for (SizeType i = 0; i < Width; ++i)
+		{
+			mask |= (uint8_t)(m_health[i] <= 0) << i;
+		}
+		return mask & UsedMask( );
+	}
+
+	// Bit per minion with any of the abilities
+	inline uint8_t AbilityMask(MinionAbilityFlags abilities) const
+	{
+		uint8_t mask = 0;
+		for (SizeType i = 0; i < Width; ++i)
+		{
+			mask |= (uint8_t)(((uint8_t)m_abilities[i] & (uint8_t)abilities) != 0) << i;
+		}
+		return mask & UsedMask( );
+	}
+
+	// Bit per minion that can attack, scanning the board rather than reading the cached mask
+	inline uint8_t ComputeCanAttackMask( ) const
+	{
+		uint8_t mask = 0;
+		for (SizeType i = 0; i < Width; ++i)
+		{
+			mask |= (uint8_t)::CanAttack(m_abilities[i], m_flags[i]) << i;
+		}
+		return mask & UsedMask( );
+	}
+
+	// Damage to every minion ignores divine shields, as the spells that do it always have
+	inline void DamageAll(uint8_t damage)
+	{
+		for (SizeType i = 0; i < Width; ++i)
+		{
+			m_health[i] -= damage;
+		}
+	}
+
+	inline void HealAll(uint8_t amount)
+	{
+		for (SizeType i = 0; i < Width; ++i)
+		{
+			int8_t healed = m_health[i] + amount;
+			m_health[i] = healed < m_max_health[i] ? healed : m_max_health[i];
+		}
+	}
+
+	inline uint8_t ComputeTotalSpelldamage( ) const
+	{
+		uint8_t spelldamage = 0;
+		for (SizeType i = 0; i < Width; ++i)
+		{
+			spelldamage += i < m_size ? m_spelldamage[i] : 0;
+		}
+		return spelldamage;
+	}
 };
 
+MinionRef::MinionRef(MinionBoard& board, uint8_t index)
+	: m_attack(board.m_attack[index])
+	, m_health(board.m_health[index])
+	, m_max_health(board.m_max_health[index])
+	, m_spelldamage(board.m_spelldamage[index])
+	, m_source_card(board.m_source_card[index])
+	, m_abilities(board.m_abilities[index])
+	, m_flags(board.m_flags[index])
+	, m_aura_totals(board.m_aura_totals[index])
+	, m_board(board)
+	, m_index(index)
+{
+}
+
+void MinionRef::StatusChanged( )
+{
+	m_board.RefreshSlot(m_index);
+}
+
 struct Player
 {
 	int8_t m_health;
 	uint8_t m_max_mana;
 	uint8_t m_mana;
 
-	FixedVector<Minion, 7, uint8_t> m_minions;
+	MinionBoard m_minions;
 	FixedVector<Card, 10, uint8_t> m_hand;
 	FixedVector<Card, 30, uint8_t> m_deck;
 
@@ -308,50 +749,297 @@ struct Player
 
 	uint8_t CalculateSpelldamage( ) const
 	{
-		uint8_t spelldamage = 0;
-		for (uint8_t i = 0; i < m_minions.Num( ); ++i)
+		return m_minions.TotalSpelldamage( );
+	}
+};
+
+// Every move has a fixed id, the same in every state: end turn, then each attacker attacking the hero,
+// then each attacker attacking each minion, then each card played without a target, then each targeted
+// card (see GetTargetedCardIndex) played at each target. Card moves use the card rather than its place
+// in the hand, so a move keeps its id however the hand is dealt.
+typedef uint16_t MoveId;
+
+static const uint8_t NumMoveTargets = 1 + 2 + 2 * MinionBoard::Capacity; // None, each player, each minion
+static const MoveId FirstAttackHeroId = 1;
+static const MoveId FirstAttackMinionId = FirstAttackHeroId + MinionBoard::Capacity;
+static const MoveId FirstPlayCardId = FirstAttackMinionId + MinionBoard::Capacity * MinionBoard::Capacity;
+static const MoveId FirstTargetedPlayId = FirstPlayCardId + (MoveId)Card::MAX;
+static const MoveId NumMoveIds = FirstTargetedPlayId + MaxTargetedCards * NumMoveTargets;
+
+inline MoveId GetMoveId(const Move& m)
+{
+	switch (m.m_type)
+	{
+	case MoveType::AttackHero:
+		return FirstAttackHeroId + m.m_source_index;
+	case MoveType::AttackMinion:
+		return FirstAttackMinionId + m.m_source_index * MinionBoard::Capacity + m.m_target_packed.m_minion;
+	case MoveType::PlayCard:
+	{
+		const uint8_t targeted_index = GetTargetedCardIndex(m.m_card);
+		if (targeted_index == NotTargeted)
 		{
-			spelldamage += m_minions[i].m_spelldamage;
+			return FirstPlayCardId + (MoveId)m.m_card;
+		}
+
+		const PackedTarget t = m.m_target_packed;
+		const uint8_t target = t.m_player == 0xF ? 0
+			: t.m_minion == 0xF ? 1 + t.m_player
+			: 3 + t.m_player * MinionBoard::Capacity + t.m_minion;
+		return FirstTargetedPlayId + targeted_index * NumMoveTargets + target;
+	}
+	default:
+		return 0;
+	}
+}
+
+inline Move GetMove(MoveId id)
+{
+	if (id >= FirstTargetedPlayId)
+	{
+		const Card c = GetTargetedCard((uint8_t)((id - FirstTargetedPlayId) / NumMoveTargets));
+		const uint8_t target = (id - FirstTargetedPlayId) % NumMoveTargets;
+		if (target == 0)
+		{
+			return Move::PlayCard(c, Move::TargetNone( ));
+		}
+		if (target < 3)
+		{
+			return Move::PlayCard(c, Move::TargetPlayer(target - 1));
+		}
+		return Move::PlayCard(c, Move::TargetMinion((target - 3) / MinionBoard::Capacity, (target - 3) % MinionBoard::Capacity));
+	}
+	if (id >= FirstPlayCardId)
+	{
+		return Move::PlayCard((Card)(id - FirstPlayCardId), Move::TargetNone( ));
+	}
+	if (id >= FirstAttackMinionId)
+	{
+		return Move::AttackMinion((uint8_t)((id - FirstAttackMinionId) / MinionBoard::Capacity), (uint8_t)((id - FirstAttackMinionId) % MinionBoard::Capacity));
+	}
+	if (id >= FirstAttackHeroId)
+	{
+		return Move::AttackHero((uint8_t)(id - FirstAttackHeroId));
+	}
+	return Move::EndTurn( );
+}
+
+inline uint8_t PopCount64(uint64_t bits)
+{
+	bits = bits - ((bits >> 1) & 0x5555555555555555ull);
+	bits = (bits & 0x3333333333333333ull) + ((bits >> 2) & 0x3333333333333333ull);
+	bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+	return (uint8_t)((bits * 0x0101010101010101ull) >> 56);
+}
+
+// Index of the nth set bit, counting from the lowest. There must be more than n bits set.
+inline uint8_t NthSetBit64(uint64_t bits, unsigned n)
+{
+	for (; n; --n)
+	{
+		bits &= bits - 1;
+	}
+
+	uint8_t index = 0;
+	while (!(bits & 1))
+	{
+		bits >>= 1;
+		++index;
+	}
+	return index;
+}
+
+// A set of moves, one bit per move id
+class MoveSet
+{
+public:
+	static const unsigned NumWords = (NumMoveIds + 63) / 64;
+
+	MoveSet( )
+		: m_words( )
+	{
+	}
+
+	inline void Add(MoveId id)
+	{
+		m_words[id >> 6] |= 1ull << (id & 63);
+	}
+
+	inline void Remove(MoveId id)
+	{
+		m_words[id >> 6] &= ~(1ull << (id & 63));
+	}
+
+	inline bool Contains(MoveId id) const
+	{
+		return (m_words[id >> 6] >> (id & 63)) & 1;
+	}
+
+	inline bool Contains(const Move& m) const
+	{
+		return Contains(GetMoveId(m));
+	}
+
+	inline void Clear( )
+	{
+		memset(m_words, 0, sizeof(m_words));
+	}
+
+	inline bool Empty( ) const
+	{
+		uint64_t any = 0;
+		for (uint64_t word : m_words)
+		{
+			any |= word;
+		}
+		return any == 0;
+	}
+
+	inline unsigned Num( ) const
+	{
+		unsigned num = 0;
+		for (uint64_t word : m_words)
+		{
+			num += PopCount64(word);
+		}
+		return num;
+	}
+
+	// The nth id in the set, counting from the lowest. There must be more than n.
+	inline MoveId Nth(unsigned n) const
+	{
+		for (unsigned word_index = 0; ; ++word_index)
+		{
+			const unsigned in_word = PopCount64(m_words[word_index]);
+			if (n < in_word)
+			{
+				return (MoveId)(word_index * 64 + NthSetBit64(m_words[word_index], n));
+			}
+			n -= in_word;
+		}
+	}
+
+	// The same, but only counting the ids that are not in other
+	inline bool AnyNotIn(const MoveSet& other) const
+	{
+		uint64_t any = 0;
+		for (unsigned i = 0; i < NumWords; ++i)
+		{
+			any |= m_words[i] & ~other.m_words[i];
+		}
+		return any != 0;
+	}
+
+	inline unsigned NumNotIn(const MoveSet& other) const
+	{
+		unsigned num = 0;
+		for (unsigned i = 0; i < NumWords; ++i)
+		{
+			num += PopCount64(m_words[i] & ~other.m_words[i]);
+		}
+		return num;
+	}
+
+	inline MoveId NthNotIn(const MoveSet& other, unsigned n) const
+	{
+		for (unsigned word_index = 0; ; ++word_index)
+		{
+			const uint64_t bits = m_words[word_index] & ~other.m_words[word_index];
+			const unsigned in_word = PopCount64(bits);
+			if (n < in_word)
+			{
+				return (MoveId)(word_index * 64 + NthSetBit64(bits, n));
+			}
+			n -= in_word;
 		}
-		return spelldamage;
 	}
+
+	inline uint64_t Word(unsigned index) const
+	{
+		return m_words[index];
+	}
+
+private:
+	uint64_t m_words[NumWords];
 };
 
+// A deathrattle waiting to be resolved once the current move has finished
 struct PendingSpellEffect
 {
-	SpellData	m_spell_data;
+	Card		m_source_card;
 	uint8_t		m_owner_index;
 };
 
-struct GameState
+// Everything about a game in progress except the list of legal moves, and all of the rules.
+// Searches copy this for every playout, so it is kept small; see the size budgets below.
+struct GameStateCore
 {
 	static const uint8_t NoMinion = 0xF;
 	static const int8_t StartingHealth = 30;
 	static const uint8_t MaxPossibleMoves = 1 + 8 * 8 + 10 * 16;
 	static const uint8_t MaxTargets = 7 + 7 + 1 + 1; // Each character
 
+	uint64_t m_hash; // Zobrist hash of the players and active player, kept up to date by ProcessMove
+	UndoJournal* m_journal; // Only set while processing a move
 	Player m_players[2];
+	FixedVector<PendingSpellEffect, MaxTargets, uint8_t> m_pending_spell_effects; // TODO: Count
 	Winner m_winner;
 	int8_t m_active_player_index;
-	FixedVector<Move, MaxPossibleMoves, uint16_t> m_possible_moves;
-	FixedVector<PendingSpellEffect, MaxTargets, uint8_t> m_pending_spell_effects; // TODO: Count
+	bool m_skip_hashing; // Leaves m_hash out of date, for states that are about to be thrown away
 
-	GameState();
-	GameState(const GameState& other);
+	GameStateCore();
+	GameStateCore(const GameStateCore& other);
+	GameStateCore& operator=(const GameStateCore& other);
 
-	void ProcessMove(const Move& m);
-	void PlayOutRandomly( std::mt19937& r );
-	void UpdatePossibleMoves();
+	// If a journal is passed, everything the move changes is saved to it first, so the move can be
+	// undone by rolling the journal back
+	void ProcessMove(const Move& m, UndoJournal* journal = nullptr);
+	// Plays random moves until the game ends. m_hash is left stale, since finished games are never looked
+	// up; rolling the journal back restores it.
+	template<typename RandomType>
+	void PlayOutRandomly( RandomType& r, UndoJournal* journal = nullptr );
+
+	// Hash of the state from scratch, which the incremental m_hash should always match
+	uint64_t ComputeHash() const;
+
+	// What CountPossibleMoves found, so GetPossibleMove doesn't have to work it out again
+	struct PossibleMoveCounts
+	{
+		uint8_t m_attackers; // Bit per minion that can attack
+		uint8_t m_attack_targets; // Bit per opponent minion that can be attacked
+		uint8_t m_num_attack_targets; // Including the opponent when there is no taunt
+		bool	m_taunt;
+		uint8_t m_num_minions; // Targetable by spells and battlecries
+		uint8_t m_card_moves[10];
+	};
+
+	// The number of legal moves, and the move at any index, in the same order as GameState::m_possible_moves
+	// but worked out from the state rather than the list. Random playouts use these so they only
+	// build the move they pick.
+	uint16_t CountPossibleMoves() const;
+	Move GetPossibleMove(uint16_t index) const;
+	uint16_t CountPossibleMoves(PossibleMoveCounts& counts) const;
+	Move GetPossibleMove(uint16_t index, const PossibleMoveCounts& counts) const;
 
 	void PrintMove(const Move& m) const;
 	void PrintState() const;
 
-	inline int8_t OppositePlayer(int8_t p_index)
+	inline int8_t OppositePlayer(int8_t p_index) const
 	{
 		return p_index == 0 ? 1 : 0;
 	}
 
 protected:
+	void ApplyMove(const Move& m);
+
+	bool CanTarget(uint8_t player_index, uint8_t minion_index) const;
+	uint8_t NumTargetableMinions( ) const;
+	uint8_t NumTargets(TargetType type, uint8_t num_minions) const;
+	PackedTarget GetTarget(TargetType type, uint8_t index) const;
+	uint8_t TargetableMask(uint8_t player_index) const;
+	uint8_t AttackTargetMask(bool& out_taunt) const;
+	uint8_t NumCardMoves(Card c, uint8_t num_minions) const;
+
 	void EndTurn();
 	void PlayCard(Card c, PackedTarget packed_target);
 	void AttackHero(uint8_t SourceIndex);
@@ -365,7 +1053,58 @@ protected:
 	void CheckVictory( );
 
 	void CheckDeadMinions( );
-	void PushDeathrattle(uint8_t owner_idx, const Minion& m);
+	void PushDeathrattle(uint8_t owner_idx, Card source_card);
+
+	void DrawOne(uint8_t player_index);
+
+	// Each of these XORs part of the state in or out of m_hash, so call them before and after changing it
+	void HashHealth(uint8_t player_index);
+	void HashMana(uint8_t player_index);
+	void HashMaxMana(uint8_t player_index);
+	void HashMinion(uint8_t player_index, uint8_t minion_index);
+	void HashMinions(uint8_t player_index);
+	void HashActivePlayer( );
+
+	// Hand cards are hashed by how many copies there are, so the order of the hand doesn't matter.
+	// Call before adding the card or after removing it.
+	void HashHandCard(uint8_t player_index, Card c);
+
+	inline void HashBoard( )
+	{
+		HashMinions(0);
+		HashMinions(1);
+	}
+
+	inline void HashAllHealth( )
+	{
+		HashHealth(0);
+		HashHealth(1);
+	}
+
+	// Call before changing any part of the state
+	template<typename T>
+	inline void Journal(T& t)
+	{
+		if (m_journal)
+		{
+			m_journal->Save(t);
+		}
+	}
+
+	inline void JournalHealth( )
+	{
+		Journal(m_players[0].m_health);
+		Journal(m_players[1].m_health);
+	}
+
+	inline void JournalMinions( )
+	{
+		Journal(m_players[0].m_minions);
+		Journal(m_players[1].m_minions);
+	}
+
+	// A MinionRef is only references into its board, so journal the board instead
+	void Journal(MinionRef& m) = delete;
 
 	template<typename FuncType>
 	void ForEachPlayer(FuncType func)
@@ -377,23 +1116,118 @@ protected:
 	}
 
 	template<typename FuncType>
-	void ForEachMinion(FuncType func)
+	void ForEachBoard(FuncType func)
 	{
 		for (uint8_t player_idx = 0; player_idx < 2; ++player_idx)
 		{
-			for (uint8_t minion_idx = 0; minion_idx < m_players[player_idx].m_minions.Num( ); ++minion_idx)
-			{
-				func(m_players[player_idx].m_minions[minion_idx]);
-			}
+			func(m_players[player_idx].m_minions);
 		}
 	}
+};
 
-	template<typename FuncType>
-	void ForEachMinion(uint8_t owner_idx, FuncType func)
+// Everything the list of possible moves is generated from. The list is the attacks, then the card plays,
+// then end turn; comparing these before and after a move says which of those parts it changed.
+struct PossibleMovesSource
+{
+	int8_t m_active_player_index;
+	uint8_t m_attackers;
+	uint8_t m_attack_targets;
+	bool m_taunt;
+	uint8_t m_num_attack_moves;
+	uint8_t m_mana;
+	uint8_t m_targetable[2];
+	decltype(Player::m_hand) m_hand;
+
+	inline bool SameAttacks(const PossibleMovesSource& other) const
 	{
-		for (uint8_t minion_idx = 0; minion_idx < m_players[owner_idx].m_minions.Num( ); ++minion_idx)
-		{
-			func(m_players[owner_idx].m_minions[minion_idx]);
-		}
+		return m_active_player_index == other.m_active_player_index
+			&& m_attackers == other.m_attackers
+			&& m_attack_targets == other.m_attack_targets
+			&& m_taunt == other.m_taunt;
+	}
+
+	inline bool SameCardPlays(const PossibleMovesSource& other) const
+	{
+		return m_active_player_index == other.m_active_player_index
+			&& m_mana == other.m_mana
+			&& m_targetable[0] == other.m_targetable[0]
+			&& m_targetable[1] == other.m_targetable[1]
+			&& m_hand.Num( ) == other.m_hand.Num( )
+			&& memcmp(&m_hand[0], &other.m_hand[0], m_hand.Num( ) * sizeof(Card)) == 0;
+	}
+};
+
+// A game state with its legal moves listed, which is what the searches expand their nodes from
+struct GameState : public GameStateCore
+{
+	FixedVector<Move, MaxPossibleMoves, uint16_t> m_possible_moves;
+	MoveSet m_legal_moves; // The same moves as m_possible_moves, for testing whether a move is legal
+	PossibleMovesSource m_possible_moves_source;
+
+	GameState();
+	GameState(const GameState& other);
+	GameState& operator=(const GameState& other);
+
+	// As GameStateCore's, but the possible moves are brought up to date afterwards too.
+	// Only the parts of the list the move could have changed are regenerated.
+	void ProcessMove(const Move& m, UndoJournal* journal = nullptr);
+	template<typename RandomType>
+	void PlayOutRandomly( RandomType& r, UndoJournal* journal = nullptr );
+
+	// Call after changing the state directly rather than through ProcessMove.
+	// Rebuilds the hash as well as the possible moves.
+	void UpdatePossibleMoves();
+
+	void JournalPossibleMoves(UndoJournal& journal);
+
+protected:
+	// Rebuilds the whole list
+	void GeneratePossibleMoves();
+	// Regenerates the attacks or card plays only if what they are generated from has changed
+	void RefreshPossibleMoves();
+
+	PossibleMovesSource GetPossibleMovesSource( ) const;
+	void WriteAttackMoves(const PossibleMovesSource& source, Move* out) const;
+	void AddCardMoves(const PossibleMovesSource& source);
+	void AddTargetedMoves(Card c, TargetType type, const PossibleMovesSource& source);
+	void AddLegalMoves(uint16_t begin, uint16_t end);
+	void RemoveLegalMoves(uint16_t begin, uint16_t end);
+};
+
+// Budgets for the parts of the state that get copied for every playout and saved into undo journals.
+// Growing past these makes every search slower, so raise them deliberately.
+static_assert(sizeof(Move) == 4, "Move should pack into 4 bytes");
+static_assert(sizeof(Minion) <= 12, "Minion is over its size budget");
+static_assert(sizeof(Player) <= 128, "Player is over its size budget");
+static_assert(sizeof(GameStateCore) <= 320, "GameStateCore is over its size budget");
+
+template<typename RandomType>
+void GameStateCore::PlayOutRandomly( RandomType& r, UndoJournal* journal )
+{
+	// Nothing looks up a playout's positions, so the hash isn't kept up to date. ProcessMove's debug check
+	// compares it from scratch on the moves that do hash.
+	m_journal = journal;
+	Journal(m_hash);
+	m_skip_hashing = true;
+
+	PossibleMoveCounts counts;
+	while (m_winner == Winner::Undetermined)
+	{
+		auto idx = RandomBelow(r, CountPossibleMoves(counts));
+		ApplyMove(GetPossibleMove((uint16_t)idx, counts));
+	}
+
+	m_skip_hashing = false;
+	m_journal = nullptr;
+}
+
+template<typename RandomType>
+void GameState::PlayOutRandomly( RandomType& r, UndoJournal* journal )
+{
+	if (journal)
+	{
+		JournalPossibleMoves(*journal);
 	}
-};
\ No newline at end of file
+	GameStateCore::PlayOutRandomly(r, journal);
+	GeneratePossibleMoves( );
+}
@@ -1,18 +1,134 @@
 #pragma once
 
 #include "GameState.h"
+#include "NodeArena.h"
+#include "SearchBudget.h"
+#include "TranspositionTable.h"
+
+#include <utility>
+#include <vector>
+
+// The engines are instantiations of the search in MCTSCore.h. Each searches within a SearchBudget, of iterations
+// or of wall clock time, and can report how many iterations it ran through out_iterations.
+// The free functions seed their generators from the seed they're given, and the Search classes draw from a
+// generator of their own, seeded from the random device unless Seed is called. A seeded search with an
+// iteration budget chooses the same moves every time, save for tree parallel SO-IS-MCTS.
+namespace MCTSCore
+{
+	struct StateNode;
+	struct InformationSetNode;
+}
 
 namespace CheatingMCTS
 {
-	Move ChooseMove(const GameState& game, unsigned iterations);
+	typedef MCTSCore::StateNode MCTSNode;
+
+	// A node an iteration went through and the slot of the edge it left by
+	typedef std::pair<MCTSNode*, uint16_t> PathStep;
+
+	Move ChooseMove(const GameState& game, const SearchBudget& budget, uint64_t seed, unsigned* out_iterations = nullptr);
+
+	// Keeps its tree between calls. Every move played in the game must be passed to MovePlayed,
+	// and the root is moved down to the matching subtree so its statistics carry over to the next search.
+	// Positions reached by different move orders share a node, through a table of at most table_bytes.
+	class Search
+	{
+	public:
+		Search(const SearchBudget& budget, size_t table_bytes = TranspositionTable<MCTSNode>::DefaultBytes);
+
+		void Reset( );
+		void Seed(uint64_t seed);
+		void MovePlayed(const Move& m);
+		Move ChooseMove(const GameState& game, unsigned* out_iterations = nullptr);
+
+	private:
+		NodeArena			m_arenas[2];
+		uint8_t				m_arena_index;
+		NodeArena::Index	m_root;
+		bool				m_root_moved;
+		SearchBudget		m_budget;
+		Random				m_random;
+		TranspositionTable<MCTSNode> m_table;
+		UndoJournal			m_journal; // Rolls each iteration back
+		std::vector<PathStep> m_path; // Of each iteration
+		std::vector<MCTSNode*> m_copy_stack; // Nodes left to copy when compacting
+	};
 }
 
 namespace DeterminizedMCTS
 {
-	Move ChooseMove(const GameState& game, unsigned determinizations, unsigned iterations);
+	typedef MCTSCore::StateNode MCTSNode;
+	typedef std::pair<MCTSNode*, uint16_t> PathStep;
+
+	// The budget's iterations are for each determinization, and its time is for the whole move
+	Move ChooseMove(const GameState& game, unsigned determinizations, const SearchBudget& budget, uint64_t seed, unsigned* out_iterations = nullptr);
+
+	// Root parallel version which searches the determinizations on up to num_threads threads of the shared pool.
+	// Each determinization has a generator of its own, so the move doesn't depend on num_threads.
+	Move ChooseMove(const GameState& game, unsigned determinizations, const SearchBudget& budget, unsigned num_threads, uint64_t seed, unsigned* out_iterations = nullptr);
+
+	// Keeps one tree per determinization between calls. Determinizations which can't follow the moves
+	// played, or which no longer match what the player to act can see, are thrown away and resampled.
+	class Search
+	{
+	public:
+		Search(unsigned determinizations, const SearchBudget& budget);
+
+		void Reset( );
+		void Seed(uint64_t seed);
+		void MovePlayed(const Move& m);
+		Move ChooseMove(const GameState& game, unsigned* out_iterations = nullptr);
+
+	private:
+		struct Determinization
+		{
+			GameState			m_state;
+			NodeArena::Index	m_root;
+		};
+
+		NodeArena	m_arenas[2];
+		uint8_t		m_arena_index;
+		bool		m_root_moved;
+		SearchBudget m_budget;
+		Random		m_random;
+		std::vector<Determinization> m_determinizations;
+		UndoJournal	m_journal; // Rolls each iteration back
+		std::vector<PathStep> m_path; // Of each iteration
+		std::vector<MCTSNode*> m_copy_stack; // Nodes left to copy when compacting
+	};
 }
 
 namespace SO_IS_MCTS
 {
-	Move ChooseMove(const GameState& game, unsigned iterations);
-}
\ No newline at end of file
+	typedef MCTSCore::InformationSetNode MCTSNode;
+	typedef std::pair<MCTSNode*, uint16_t> PathStep;
+
+	Move ChooseMove(const GameState& game, const SearchBudget& budget, uint64_t seed, unsigned* out_iterations = nullptr);
+
+	// Tree parallel version where up to num_threads threads of the shared pool search one tree,
+	// using virtual loss to keep them on different paths
+	Move ChooseMove(const GameState& game, const SearchBudget& budget, unsigned num_threads, uint64_t seed, unsigned* out_iterations = nullptr);
+
+	// Keeps its information set tree between calls, following the moves played by both players
+	class Search
+	{
+	public:
+		Search(const SearchBudget& budget);
+
+		void Reset( );
+		void Seed(uint64_t seed);
+		void MovePlayed(const Move& m);
+		Move ChooseMove(const GameState& game, unsigned* out_iterations = nullptr);
+
+	private:
+		NodeArena			m_arenas[2];
+		uint8_t				m_arena_index;
+		NodeArena::Index	m_root;
+		bool				m_root_moved;
+		SearchBudget		m_budget;
+		Random				m_random;
+		UndoJournal			m_journal; // Rolls each iteration back
+		std::vector<PathStep> m_path; // Of each iteration
+		std::vector<MCTSNode*> m_copy_stack; // Nodes left to copy when compacting
+	};
+}
@@ -0,0 +1,599 @@
+#pragma once
+
+#include "GameState.h"
+#include "NodeArena.h"
+#include "SearchBudget.h"
+#include "TranspositionTable.h"
+#include "UCT.h"
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// The tree search shared by every MCTS engine, put together at compile time from policies:
+//   Sampling, for what the search sees of hidden cards: PerfectInformation, SearchDeterminization or
+//   IterationDeterminization
+//   Selection, for how a child is picked and what is recorded on the way down: UCB1 or AvailabilityUCB1
+//   NodeType, for how children and their statistics are stored: StateNode or InformationSetNode
+//   Transpositions, for whether positions reached by different move orders share a node:
+//   NoTranspositions or a TranspositionTable
+// Results are backed up along the path each iteration took, so the same loop works for trees and for the
+// DAGs transpositions make.
+namespace MCTSCore
+{
+	static const uint16_t NoSlot = 0xFFFF;
+
+	// Resamples the hidden cards of game in place, journaling everything it changes if given a journal
+	inline void Determinize(GameState& game, Random& r, UndoJournal* journal)
+	{
+		int8_t opponent_idx = (int8_t)abs(game.m_active_player_index - 1);
+		Player& active = game.m_players[game.m_active_player_index];
+		Player& opponent = game.m_players[opponent_idx];
+
+		if (journal)
+		{
+			journal->Save(opponent.m_hand);
+			journal->Save(active.m_deck);
+			journal->Save(opponent.m_deck);
+			game.JournalPossibleMoves(*journal);
+			journal->Save(game.m_hash);
+		}
+
+		// Randomize cards in opponent's hand
+		for (uint8_t i = 0; i < opponent.m_hand.Num(); ++i)
+		{
+			auto idx = RandomBelow(r, (uint32_t)DeckPossibleCards.size() + 1);
+			Card c = idx == DeckPossibleCards.size() ? Card::Coin : DeckPossibleCards[idx];
+			opponent.m_hand[i] = c;
+		}
+
+		// Shuffle my deck
+		active.m_deck.Shuffle(r);
+
+		// Randomize opponent's deck
+		for (uint8_t i = 0; i < opponent.m_deck.Num(); ++i)
+		{
+			Card c = DeckPossibleCards[RandomBelow(r, (uint32_t)DeckPossibleCards.size())];
+			opponent.m_deck[i] = c;
+		}
+
+		// This should not have actually changed the possible moves, but just to be safe against future changes
+		game.UpdatePossibleMoves();
+	}
+
+	// Sampling policies. SampleSearch is applied by the engine to each state it builds a tree for,
+	// and SampleIteration by the core at the start of every iteration.
+
+	// Searches the real state, hidden cards and all
+	struct PerfectInformation
+	{
+		static inline void SampleSearch(GameState&, Random&) {}
+		static inline void SampleIteration(GameState&, Random&, UndoJournal&) {}
+	};
+
+	// Searches one guess at the hidden cards, fixed for the whole tree
+	struct SearchDeterminization
+	{
+		static inline void SampleSearch(GameState& game, Random& r) { Determinize(game, r, nullptr); }
+		static inline void SampleIteration(GameState&, Random&, UndoJournal&) {}
+	};
+
+	// Guesses the hidden cards again for each iteration, so the tree is over what the player can see
+	struct IterationDeterminization
+	{
+		static inline void SampleSearch(GameState&, Random&) {}
+		static inline void SampleIteration(GameState& game, Random& r, UndoJournal& journal) { Determinize(game, r, &journal); }
+	};
+
+	// A node whose state is fully known, so its moves can be listed when it is made. It is followed in the
+	// same allocation by parallel arrays with an entry for each of those moves: the move, then the edge's wins,
+	// visits and child index. The first m_num_children entries have been expanded and the rest are untried.
+	// Statistics live on the edges, so a node shared by several parents keeps separate results for each.
+	struct StateNode
+	{
+		uint64_t			m_hash;
+		NodeArena::Index	m_index; // Of this node, as transposition tables hand out pointers
+		NodeArena::Index	m_copy; // Only used while compacting
+		uint32_t			m_visits;
+		uint16_t			m_num_children;
+		uint16_t			m_num_moves;
+
+		static NodeArena::Index New(NodeArena& arena, const GameState& state)
+		{
+			const uint16_t num_moves = state.m_possible_moves.Num( );
+			const NodeArena::Index index = arena.AllocateIndex(AllocationSize(num_moves));
+			StateNode* node = arena.Get<StateNode>(index);
+			node->m_hash = state.m_hash;
+			node->m_index = index;
+			node->m_copy = NodeArena::NoIndex;
+			node->m_visits = 0;
+			node->m_num_children = 0;
+			node->m_num_moves = num_moves;
+			memcpy(node->Moves( ), &state.m_possible_moves[0], num_moves * sizeof(Move));
+			memset(node->EdgeWins( ), 0, num_moves * 2 * sizeof(uint32_t)); // Wins and visits
+			return index;
+		}
+
+		StateNode(const StateNode& other) = delete;
+
+		static inline size_t AllocationSize(uint16_t num_moves)
+		{
+			return sizeof(StateNode) + num_moves * (sizeof(Move) + 2 * sizeof(uint32_t) + sizeof(NodeArena::Index));
+		}
+
+		inline Move* Moves( ) { return reinterpret_cast<Move*>(this + 1); }
+		inline const Move* Moves( ) const { return reinterpret_cast<const Move*>(this + 1); }
+		inline uint32_t* EdgeWins( ) { return reinterpret_cast<uint32_t*>(Moves( ) + m_num_moves); }
+		inline const uint32_t* EdgeWins( ) const { return reinterpret_cast<const uint32_t*>(Moves( ) + m_num_moves); }
+		inline uint32_t* EdgeVisits( ) { return EdgeWins( ) + m_num_moves; }
+		inline const uint32_t* EdgeVisits( ) const { return EdgeWins( ) + m_num_moves; }
+		inline NodeArena::Index* Children( ) { return reinterpret_cast<NodeArena::Index*>(EdgeVisits( ) + m_num_moves); }
+		inline const NodeArena::Index* Children( ) const { return reinterpret_cast<const NodeArena::Index*>(EdgeVisits( ) + m_num_moves); }
+
+		inline const uint32_t* Wins(const NodeArena&) const { return EdgeWins( ); }
+		inline const uint32_t* Visits(const NodeArena&) const { return EdgeVisits( ); }
+		inline Move MoveAt(const NodeArena&, uint16_t slot) const { return Moves( )[slot]; }
+
+		inline bool HasUntriedMoves(const GameState&) const
+		{
+			return m_num_children < m_num_moves;
+		}
+
+		inline bool HasChildren() const
+		{
+			return m_num_children != 0;
+		}
+
+		// Moves a random untried move into the next child slot
+		inline Move ChooseUntriedMove(const NodeArena&, const GameState&, Random& r)
+		{
+			const uint16_t slot = m_num_children;
+			const uint16_t pick = slot + (uint16_t)RandomBelow(r, m_num_moves - slot);
+			std::swap(Moves( )[slot], Moves( )[pick]);
+			return Moves( )[slot];
+		}
+
+		// Adds the child for the move ChooseUntriedMove last returned, and returns its slot
+		inline uint16_t AddChild(NodeArena&, Move, NodeArena::Index child)
+		{
+			Children( )[m_num_children] = child;
+			return m_num_children++;
+		}
+
+		inline void Backup(NodeArena&, uint16_t slot, bool won)
+		{
+			EdgeVisits( )[slot]++;
+			if (won) EdgeWins( )[slot]++;
+		}
+
+		inline NodeArena::Index FindChild(const NodeArena&, const Move& m) const
+		{
+			for (uint16_t slot = 0; slot < m_num_children; ++slot)
+			{
+				if (Moves( )[slot] == m)
+				{
+					return Children( )[slot];
+				}
+			}
+			return NodeArena::NoIndex;
+		}
+
+		// Whether this node could have been created from the given state
+		inline bool Matches(const GameState& state) const
+		{
+			return m_hash == state.m_hash;
+		}
+
+		// For CopyGraph
+		inline NodeArena::Index CopyInto(const NodeArena&, NodeArena& to) const
+		{
+			const size_t size = AllocationSize(m_num_moves);
+			const NodeArena::Index index = to.AllocateIndex(size);
+			StateNode* copy = to.Get<StateNode>(index);
+			memcpy(copy, this, size);
+			copy->m_index = index;
+			copy->m_copy = NodeArena::NoIndex;
+			return index;
+		}
+
+		inline uint16_t NumChildren( ) const
+		{
+			return m_num_children;
+		}
+
+		inline NodeArena::Index ChildIndex(const NodeArena&, uint16_t slot) const
+		{
+			return Children( )[slot];
+		}
+
+		inline NodeArena::Index& ChildIndex(const NodeArena&, uint16_t slot)
+		{
+			return Children( )[slot];
+		}
+	};
+
+	// The children of an InformationSetNode as parallel arrays in one block: wins, visits and availability,
+	// which is how often each child was legal when its parent was visited, then the child's node, move and move id
+	struct ChildArrays
+	{
+		uint32_t*			m_wins;
+		uint32_t*			m_visits;
+		uint32_t*			m_availability;
+		NodeArena::Index*	m_nodes;
+		Move*				m_moves;
+		MoveId*				m_ids;
+
+		ChildArrays(uint8_t* block, uint16_t capacity)
+			: m_wins(reinterpret_cast<uint32_t*>(block))
+			, m_visits(m_wins + capacity)
+			, m_availability(m_visits + capacity)
+			, m_nodes(reinterpret_cast<NodeArena::Index*>(m_availability + capacity))
+			, m_moves(reinterpret_cast<Move*>(m_nodes + capacity))
+			, m_ids(reinterpret_cast<MoveId*>(m_moves + capacity))
+		{
+		}
+
+		static inline size_t Size(uint16_t capacity)
+		{
+			return capacity * (3 * sizeof(uint32_t) + sizeof(NodeArena::Index) + sizeof(Move) + sizeof(MoveId));
+		}
+	};
+
+	// A node for a set of states the player can't tell apart. The moves legal at it change with each
+	// determinization, so its children can't be allocated up front. They live in a block of ChildArrays
+	// which is reallocated at twice the size when it fills up.
+	struct InformationSetNode
+	{
+		static const uint16_t FirstCapacity = 8;
+
+		NodeArena::Index m_index;
+		NodeArena::Index m_copy; // Only used while compacting
+		NodeArena::Index m_children; // NoIndex until the first child is added
+		uint32_t m_visits;
+		uint16_t m_num_children;
+		uint16_t m_capacity;
+
+		MoveSet m_tried; // The moves of every child
+
+		static NodeArena::Index New(NodeArena& arena, const GameState&)
+		{
+			const NodeArena::Index index = arena.NewIndex<InformationSetNode>( );
+			arena.Get<InformationSetNode>(index)->m_index = index;
+			return index;
+		}
+
+		InformationSetNode( )
+			: m_index(NodeArena::NoIndex)
+			, m_copy(NodeArena::NoIndex)
+			, m_children(NodeArena::NoIndex)
+			, m_visits(0)
+			, m_num_children(0)
+			, m_capacity(0)
+		{
+		}
+
+		inline ChildArrays Children(const NodeArena& arena) const
+		{
+			return ChildArrays(m_capacity ? arena.Get<uint8_t>(m_children) : nullptr, m_capacity);
+		}
+
+		inline const uint32_t* Wins(const NodeArena& arena) const { return Children(arena).m_wins; }
+		inline const uint32_t* Visits(const NodeArena& arena) const { return Children(arena).m_visits; }
+		inline Move MoveAt(const NodeArena& arena, uint16_t slot) const { return Children(arena).m_moves[slot]; }
+
+		inline bool HasUntriedMoves(const GameState& game) const
+		{
+			return game.m_legal_moves.AnyNotIn(m_tried);
+		}
+
+		inline bool HasChildren() const
+		{
+			return m_num_children != 0;
+		}
+
+		inline Move ChooseUntriedMove(const NodeArena&, const GameState& game, Random& r) const
+		{
+			const unsigned num_untried = game.m_legal_moves.NumNotIn(m_tried);
+			return GetMove(game.m_legal_moves.NthNotIn(m_tried, RandomBelow(r, num_untried)));
+		}
+
+		// Adds a child which has been available once, and returns its slot
+		inline uint16_t AddChild(NodeArena& arena, Move m, NodeArena::Index child)
+		{
+			if (m_num_children == m_capacity)
+			{
+				Grow(arena);
+			}
+
+			const uint16_t slot = m_num_children++;
+			const ChildArrays children = Children(arena);
+			children.m_wins[slot] = 0;
+			children.m_visits[slot] = 0;
+			children.m_availability[slot] = 1;
+			children.m_nodes[slot] = child;
+			children.m_moves[slot] = m;
+			children.m_ids[slot] = GetMoveId(m);
+			m_tried.Add(children.m_ids[slot]);
+			return slot;
+		}
+
+		inline void Grow(NodeArena& arena)
+		{
+			const uint16_t capacity = m_capacity ? m_capacity * 2 : FirstCapacity;
+			const NodeArena::Index block = arena.AllocateIndex(ChildArrays::Size(capacity));
+			if (m_num_children)
+			{
+				const ChildArrays from = Children(arena);
+				const ChildArrays to(arena.Get<uint8_t>(block), capacity);
+				memcpy(to.m_wins, from.m_wins, m_num_children * sizeof(uint32_t));
+				memcpy(to.m_visits, from.m_visits, m_num_children * sizeof(uint32_t));
+				memcpy(to.m_availability, from.m_availability, m_num_children * sizeof(uint32_t));
+				memcpy(to.m_nodes, from.m_nodes, m_num_children * sizeof(NodeArena::Index));
+				memcpy(to.m_moves, from.m_moves, m_num_children * sizeof(Move));
+				memcpy(to.m_ids, from.m_ids, m_num_children * sizeof(MoveId));
+			}
+			m_children = block;
+			m_capacity = capacity;
+		}
+
+		inline void Backup(NodeArena& arena, uint16_t slot, bool won)
+		{
+			const ChildArrays children = Children(arena);
+			children.m_visits[slot]++;
+			if (won) children.m_wins[slot]++;
+		}
+
+		inline NodeArena::Index FindChild(const NodeArena& arena, const Move& m) const
+		{
+			const MoveId id = GetMoveId(m);
+			const ChildArrays children = Children(arena);
+			for (uint16_t i = 0; i < m_num_children; ++i)
+			{
+				if (children.m_ids[i] == id)
+				{
+					return children.m_nodes[i];
+				}
+			}
+			return NodeArena::NoIndex;
+		}
+
+		// For CopyGraph
+		inline NodeArena::Index CopyInto(const NodeArena& from, NodeArena& to) const
+		{
+			const NodeArena::Index index = to.NewIndex<InformationSetNode>(*this);
+			InformationSetNode* copy = to.Get<InformationSetNode>(index);
+			copy->m_index = index;
+			copy->m_copy = NodeArena::NoIndex;
+			if (m_capacity)
+			{
+				copy->m_children = to.AllocateIndex(ChildArrays::Size(m_capacity));
+				memcpy(to.Get<uint8_t>(copy->m_children), from.Get<uint8_t>(m_children), ChildArrays::Size(m_capacity));
+			}
+			return index;
+		}
+
+		inline uint16_t NumChildren( ) const
+		{
+			return m_num_children;
+		}
+
+		inline NodeArena::Index ChildIndex(const NodeArena& arena, uint16_t slot) const
+		{
+			return Children(arena).m_nodes[slot];
+		}
+
+		inline NodeArena::Index& ChildIndex(const NodeArena& arena, uint16_t slot)
+		{
+			return Children(arena).m_nodes[slot];
+		}
+	};
+
+	// Selection policies. Select returns the slot of the child to follow, or NoSlot if there is none, and
+	// Visited is called on each node the iteration leaves, before the child is added if it was expanded.
+
+	// UCB1 with the node's own visits, for nodes whose children are always legal
+	struct UCB1
+	{
+		template<typename NodeType>
+		static inline uint16_t Select(const NodeType& node, const NodeArena& arena, const GameState&)
+		{
+			float scores[GameState::MaxPossibleMoves];
+			UCTScores(node.Wins(arena), node.Visits(arena), node.m_num_children, node.m_visits, scores);
+			return (uint16_t)BestScore(scores, node.m_num_children);
+		}
+
+		template<typename NodeType>
+		static inline void Visited(NodeType&, const NodeArena&, const GameState&) {}
+	};
+
+	// UCB1 over the children legal in this determinization, each using how often it was available instead
+	// of its parent's visits. Needs an InformationSetNode.
+	struct AvailabilityUCB1
+	{
+		static inline uint16_t Select(const InformationSetNode& node, const NodeArena& arena, const GameState& state)
+		{
+			const ChildArrays children = node.Children(arena);
+			float scores[NumMoveIds];
+			UCTScores(children.m_wins, children.m_visits, children.m_availability, node.m_num_children, scores);
+			for (uint16_t i = 0; i < node.m_num_children; ++i)
+			{
+				scores[i] = state.m_legal_moves.Contains(children.m_ids[i]) ? scores[i] : -1.0f;
+			}
+
+			const uint16_t best = (uint16_t)BestScore(scores, node.m_num_children);
+			return scores[best] < 0.0f ? NoSlot : best;
+		}
+
+		static inline void Visited(InformationSetNode& node, const NodeArena& arena, const GameState& state)
+		{
+			const ChildArrays children = node.Children(arena);
+			for (uint16_t i = 0; i < node.m_num_children; ++i)
+			{
+				children.m_availability[i] += state.m_legal_moves.Contains(children.m_ids[i]) ? 1 : 0;
+			}
+		}
+	};
+
+	// Transposition policy which never shares nodes. A TranspositionTable of the node type is the other choice.
+	template<typename NodeType>
+	struct NoTranspositions
+	{
+		inline NodeType* Find(uint64_t) const { return nullptr; }
+		inline void Insert(uint64_t, NodeType*) {}
+		inline void Clear( ) {}
+	};
+
+	// Puts a copied node back in the table. Only nodes which can be shared need to know their hash.
+	template<typename NodeType>
+	inline void Reinsert(NoTranspositions<NodeType>&, NodeType*) {}
+
+	template<typename NodeType>
+	inline void Reinsert(TranspositionTable<NodeType>& table, NodeType* node)
+	{
+		table.Insert(node->m_hash, node);
+	}
+
+	template<typename Sampling, typename Selection, typename NodeType, typename Transpositions = NoTranspositions<NodeType> >
+	struct Core
+	{
+		// A node an iteration went through and the slot of the edge it left by
+		typedef std::pair<NodeType*, uint16_t> PathStep;
+
+		static NodeArena::Index NewRoot(NodeArena& arena, Transpositions& table, const GameState& game)
+		{
+			const NodeArena::Index root = NodeType::New(arena, game);
+			table.Insert(game.m_hash, arena.Get<NodeType>(root));
+			return root;
+		}
+
+		// Searches until the limit is reached, and returns how many iterations were run. The journal is left
+		// as it was found.
+		static unsigned RunIterations(NodeArena::Index root, const GameState& game, const SearchLimit& limit, NodeArena& arena, Transpositions& table, std::vector<PathStep>& path, UndoJournal& journal, Random& r)
+		{
+			// Sampling and tree moves are journaled and rolled back, so only the playout copies the state
+			GameState sim_state(game);
+			const UndoJournal::Mark start = journal.GetMark( );
+
+			unsigned iter = 0;
+			for (; !limit.Done(iter); ++iter)
+			{
+				Sampling::SampleIteration(sim_state, r, journal);
+
+				NodeType* node = arena.Get<NodeType>(root);
+				path.clear( );
+
+				// Fully expand each node before expanding its children.
+				// Expanding into a position already in the table joins it, and selection carries on from there.
+				for (;;)
+				{
+					if (node->HasUntriedMoves(sim_state))
+					{
+						Selection::Visited(*node, arena, sim_state);
+						const Move m = node->ChooseUntriedMove(arena, sim_state, r);
+						sim_state.ProcessMove(m, &journal);
+
+						NodeType* child = table.Find(sim_state.m_hash);
+						const bool transposition = child != nullptr;
+						if (!transposition)
+						{
+							child = arena.Get<NodeType>(NodeType::New(arena, sim_state));
+							table.Insert(sim_state.m_hash, child);
+						}
+						path.emplace_back(node, node->AddChild(arena, m, child->m_index));
+						node = child;
+
+						if (!transposition)
+							break;
+					}
+					else if (node->HasChildren( ))
+					{
+						const uint16_t slot = Selection::Select(*node, arena, sim_state);
+						if (slot == NoSlot)
+							break;
+
+						Selection::Visited(*node, arena, sim_state);
+						sim_state.ProcessMove(node->MoveAt(arena, slot), &journal);
+						path.emplace_back(node, slot);
+						node = arena.Get<NodeType>(node->ChildIndex(arena, slot));
+					}
+					else
+					{
+						break;
+					}
+				}
+				path.emplace_back(node, NoSlot);
+
+				GameStateCore playout_state(sim_state);
+				playout_state.PlayOutRandomly(r);
+				bool won = playout_state.m_winner == (Winner)game.m_active_player_index;
+				journal.RollBack(start);
+
+				for (const PathStep& step : path)
+				{
+					step.first->m_visits++;
+					if (step.second != NoSlot)
+					{
+						step.first->Backup(arena, step.second, won);
+					}
+				}
+			}
+
+			return iter;
+		}
+
+		// The most visited of the root's children that is legal in game, which a reused root may not all be
+		static Move MostVisitedMove(NodeArena::Index root, const NodeArena& arena, const GameState& game)
+		{
+			const NodeType* root_node = arena.Get<NodeType>(root);
+			const uint32_t* visits = root_node->Visits(arena);
+			Move best_move = Move::EndTurn( );
+			uint32_t best_visits = 0;
+			for (uint16_t slot = 0; slot < root_node->m_num_children; ++slot)
+			{
+				const Move m = root_node->MoveAt(arena, slot);
+				if (visits[slot] > best_visits && game.m_legal_moves.Contains(m))
+				{
+					best_visits = visits[slot];
+					best_move = m;
+				}
+			}
+			return best_move;
+		}
+
+		// Copy every node reachable from root into another arena, keeping shared nodes shared, and refill the table.
+		// An explicit stack is used so deep trees can't overflow the call stack.
+		static NodeArena::Index CopyGraph(NodeArena::Index root, NodeArena& from, NodeArena& to, Transpositions& table, std::vector<NodeType*>& stack)
+		{
+			auto copy_node = [&](NodeType* node)
+			{
+				node->m_copy = node->CopyInto(from, to);
+				Reinsert(table, to.Get<NodeType>(node->m_copy));
+				stack.push_back(node);
+			};
+
+			table.Clear( );
+			stack.clear( );
+			copy_node(from.Get<NodeType>(root));
+			const NodeArena::Index new_root = from.Get<NodeType>(root)->m_copy;
+			while (stack.size( ))
+			{
+				NodeType* node = stack.back( );
+				stack.pop_back( );
+
+				// Old nodes are about to be thrown away, so they can remember their copies as we go
+				NodeType* copy = to.Get<NodeType>(node->m_copy);
+				for (uint16_t slot = 0; slot < node->NumChildren( ); ++slot)
+				{
+					NodeType* child = from.Get<NodeType>(node->ChildIndex(from, slot));
+					if (child->m_copy == NodeArena::NoIndex)
+					{
+						copy_node(child);
+					}
+					copy->ChildIndex(to, slot) = child->m_copy;
+				}
+			}
+
+			return new_root;
+		}
+	};
+}
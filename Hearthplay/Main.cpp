@@ -3,15 +3,20 @@
 #include "MCTS.h"
 #include "Clock.h"
 #include "Tests.h"
+#include "Benchmarks.h"
 #include "Tournament.h"
+#include "GameLog.h"
+#include "Ratings.h"
 
 #include <cstdio>
+#include <cstdlib>
 #include <random>
+#include <string>
 #include <thread>
 
 std::random_device GlobalRandomDevice;
 
-GameState SetupGame(const Card (&deck)[30], std::mt19937& r)
+GameState SetupGame(const Card (&deck)[30], Random& r)
 {
 	GameState game;
 	game.m_players[0].m_deck.Set(deck, sizeof(deck) / sizeof(Card));
@@ -38,7 +43,7 @@ GameState SetupGame(const Card (&deck)[30], std::mt19937& r)
 
 void BenchmarkRandomPlay(const Card(&deck)[30])
 {
-	std::mt19937 r(GlobalRandomDevice());
+	Random r(GlobalRandomDevice());
 	for (int i = 0; i < 1000; ++i)
 	{
 		GameState game = SetupGame(deck, r);
@@ -52,26 +57,47 @@ struct Setting
 	bool		m_enabled;
 	bool		m_takes_uint;
 	uint32_t	m_uint_value;
+	bool		m_takes_string;
+	std::string	m_string_value;
 
-	Setting(const char* name, bool takes_uint)
+	Setting(const char* name, bool takes_uint, bool takes_string = false)
 		: m_name( name )
 		, m_enabled( false )
 		, m_takes_uint( takes_uint )
 		, m_uint_value( 0 )
+		, m_takes_string( takes_string )
 	{
 	}
 };
 
 Setting Setting_RunTournament = { "-tournament", true };
 Setting Setting_RunTournamentMT = { "-tournamentmt", true };
+Setting Setting_RunTournamentSPRT = { "-sprt", true };
+Setting Setting_SPRTBounds = { "-sprtbounds", false, true };
+Setting Setting_RunTournamentRated = { "-rated", true };
+Setting Setting_MoveTime = { "-movems", true };
+Setting Setting_Iterations = { "-iterations", true };
+Setting Setting_Seed = { "-seed", false, true }; // 64 bits, so too wide for m_uint_value
+Setting Setting_GameLog = { "-gamelog", false, true };
+Setting Setting_GameLogToCSV = { "-gamelogtocsv", false, true };
 Setting Setting_Wait= { "-wait", false };
 Setting Setting_RunTests= { "-runtests", false };
+Setting Setting_RunBenchmarks = { "-benchmark", false };
 Setting Setting_PrintDeckPossibleCards = { "-printimplementedcards", false };
 
 Setting* Settings[] = {
 	&Setting_RunTournament,
 	&Setting_RunTournamentMT,
+	&Setting_RunTournamentSPRT,
+	&Setting_SPRTBounds,
+	&Setting_RunTournamentRated,
+	&Setting_MoveTime,
+	&Setting_Iterations,
+	&Setting_Seed,
+	&Setting_GameLog,
+	&Setting_GameLogToCSV,
 	&Setting_RunTests,
+	&Setting_RunBenchmarks,
 	&Setting_Wait,
 	&Setting_PrintDeckPossibleCards
 };
@@ -95,6 +121,11 @@ int main(int argc, char** argv )
 					Settings[j]->m_uint_value = (uint32_t)val;
 					++i;
 				}
+				else if (Settings[j]->m_takes_string && i + 1 < argc)
+				{
+					Settings[j]->m_string_value = argv[i + 1];
+					++i;
+				}
 
 				found = true;
 				break;
@@ -106,7 +137,7 @@ int main(int argc, char** argv )
 		}
 	}
 
-	std::mt19937 r(GlobalRandomDevice( ));
+	Random r(GlobalRandomDevice( ));
 
 	if (Setting_PrintDeckPossibleCards.m_enabled)
 	{
@@ -126,6 +157,63 @@ int main(int argc, char** argv )
 		RunTests();
 	}
 
+	if (Setting_RunBenchmarks.m_enabled)
+	{
+		RunBenchmarks( );
+	}
+
+	// Tournament AIs search for a fixed time per move if one is given, rather than a fixed number of iterations
+	TournamentOptions options;
+	if (Setting_MoveTime.m_enabled)
+	{
+		options.m_move_time = std::chrono::milliseconds(Setting_MoveTime.m_uint_value);
+	}
+	if (Setting_Iterations.m_enabled)
+	{
+		options.m_iterations = Setting_Iterations.m_uint_value;
+	}
+	if (Setting_Seed.m_enabled)
+	{
+		const char* text = Setting_Seed.m_string_value.c_str( );
+		char* end;
+		const unsigned long long seed = strtoull(text, &end, 10);
+		if (end != text && *end == '\0')
+		{
+			options.m_seed = seed;
+		}
+		else
+		{
+			printf("Couldn't read seed %s, using %llu\n", text, (unsigned long long)options.m_seed);
+		}
+	}
+
+	if (Setting_RunTournament.m_enabled || Setting_RunTournamentMT.m_enabled || Setting_RunTournamentSPRT.m_enabled || Setting_RunTournamentRated.m_enabled)
+	{
+		if (Setting_MoveTime.m_enabled)
+		{
+			printf("Searching for %u ms a move\n", Setting_MoveTime.m_uint_value);
+		}
+		else
+		{
+			printf("Searching for %u iterations a move\n", options.m_iterations);
+		}
+		printf("Seed %llu\n", (unsigned long long)options.m_seed);
+	}
+
+	// Tournaments append every game they play to the log, if one is given
+	GameLog game_log;
+	if (Setting_GameLog.m_enabled)
+	{
+		if (game_log.Open(Setting_GameLog.m_string_value.c_str( )))
+		{
+			options.m_log = &game_log;
+		}
+		else
+		{
+			printf("Couldn't open game log %s\n", Setting_GameLog.m_string_value.c_str( ));
+		}
+	}
+
 	if (Setting_RunTournamentMT.m_enabled)
 	{
 		printf("std::thread::hardware_concurrency: %u\n", std::thread::hardware_concurrency( ));
@@ -135,7 +223,7 @@ int main(int argc, char** argv )
 		printf("Playing %d rounds\n\n", num_rounds);
 
 		PlayResults results;
-		AITournamentMT(num_rounds, results);
+		AITournamentMT(num_rounds, results, options);
 
 		auto tourn_end = std::chrono::system_clock::now( );
 		auto duration_min = std::chrono::duration_cast<std::chrono::seconds>(tourn_end - tourn_start).count( ) / 60.0f;
@@ -151,7 +239,7 @@ int main(int argc, char** argv )
 		printf("Playing %d rounds\n\n", num_rounds);
 
 		PlayResults results;
-		AITournament(num_rounds, results);
+		AITournament(num_rounds, results, options);
 
 		auto tourn_end = std::chrono::system_clock::now( );
 		auto duration_min = std::chrono::duration_cast<std::chrono::seconds>(tourn_end - tourn_start).count( ) / 60.0f;
@@ -160,6 +248,73 @@ int main(int argc, char** argv )
 		results.Print( );
 	}
 
+	if (Setting_RunTournamentSPRT.m_enabled)
+	{
+		// Bounds are given as elo0,elo1,alpha,beta, and any left out keep their defaults
+		SPRT test;
+		double* bounds[] = { &test.m_elo0, &test.m_elo1, &test.m_alpha, &test.m_beta };
+		const char* text = Setting_SPRTBounds.m_string_value.c_str( );
+		for (double* bound : bounds)
+		{
+			char* end;
+			const double value = strtod(text, &end);
+			if (end == text)
+				break;
+
+			*bound = value;
+			text = *end == ',' ? end + 1 : end;
+		}
+
+		const uint32_t max_games = Setting_RunTournamentSPRT.m_uint_value;
+		auto tourn_start = std::chrono::system_clock::now( );
+		printf("Playing up to %u games a pairing\n\n", max_games);
+
+		PlayResults results;
+		SPRTResults tests;
+		AITournamentSPRT(max_games, test, results, tests, options);
+
+		auto tourn_end = std::chrono::system_clock::now( );
+		auto duration_min = std::chrono::duration_cast<std::chrono::seconds>(tourn_end - tourn_start).count( ) / 60.0f;
+		printf("\nPlayed in %.2f minutes\n\n", duration_min);
+
+		tests.Print(test);
+	}
+
+	if (Setting_RunTournamentRated.m_enabled)
+	{
+		const uint32_t num_games = Setting_RunTournamentRated.m_uint_value;
+		auto tourn_start = std::chrono::system_clock::now( );
+		printf("Playing %u rated games\n\n", num_games);
+
+		PlayResults results;
+		Ratings ratings((unsigned)AIType::MAX);
+		AITournamentRated(num_games, results, ratings, options);
+
+		auto tourn_end = std::chrono::system_clock::now( );
+		auto duration_min = std::chrono::duration_cast<std::chrono::seconds>(tourn_end - tourn_start).count( ) / 60.0f;
+		printf("\nPlayed %u games in %.2f minutes\n\n", num_games, duration_min);
+
+		results.Print( );
+		printf("\n");
+		ratings.Print(AINames);
+	}
+
+	game_log.Close( );
+
+	// Converts a game log to a CSV file next to it
+	if (Setting_GameLogToCSV.m_enabled)
+	{
+		const std::string csv_path = Setting_GameLogToCSV.m_string_value + ".csv";
+		if (ConvertGameLogToCSV(Setting_GameLogToCSV.m_string_value.c_str( ), csv_path.c_str( )))
+		{
+			printf("Wrote %s\n", csv_path.c_str( ));
+		}
+		else
+		{
+			printf("Couldn't convert game log %s\n", Setting_GameLogToCSV.m_string_value.c_str( ));
+		}
+	}
+
 	if (Setting_Wait.m_enabled)
 	{
 		getc(stdin);
@@ -0,0 +1,21 @@
+#include "NodeArena.h"
+
+NodeArena::NodeArena( )
+	: m_head(nullptr)
+	, m_block_index(0)
+	, m_offset(0)
+{
+	m_blocks.emplace_back(new uint8_t[BlockSize]);
+	m_head = m_blocks[0].get( );
+}
+
+void NodeArena::NextBlock( )
+{
+	++m_block_index;
+	if (m_block_index == m_blocks.size( ))
+	{
+		m_blocks.emplace_back(new uint8_t[BlockSize]);
+	}
+	m_head = m_blocks[m_block_index].get( );
+	m_offset = 0;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for search tree nodes.
+// Memory is handed out from a list of fixed size blocks which are kept around when the arena is reset,
+// so Reset is O(1) and a warmed up arena never touches the heap. Nothing allocated from an arena is ever
+// destructed, so only trivially destructible types may be allocated from it.
+//
+// Allocations can also be referred to by a 32 bit Index, counting IndexAlignment byte units from the start
+// of the first block, which lets nodes link to each other in half the space of a pointer.
+class NodeArena
+{
+public:
+	static const size_t BlockSize = 1 << 20;
+	static const size_t IndexAlignment = 8;
+
+	typedef uint32_t Index;
+	static const Index NoIndex = 0xFFFFFFFF;
+
+	NodeArena( );
+	NodeArena(const NodeArena& other) = delete;
+	NodeArena& operator=(const NodeArena& other) = delete;
+
+	template<typename T, typename... ArgTypes>
+	inline T* New(ArgTypes&&... args)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "Arena allocated types are never destructed");
+		void* mem = Allocate(sizeof(T), std::alignment_of<T>::value);
+		return new(mem) T(std::forward<ArgTypes>(args)...);
+	}
+
+	inline void* Allocate(size_t size, size_t align)
+	{
+		size_t offset = (m_offset + align - 1) & ~(align - 1);
+		if (offset + size > BlockSize)
+		{
+			NextBlock( );
+			offset = 0;
+		}
+		m_offset = offset + size;
+		return m_head + offset;
+	}
+
+	inline Index AllocateIndex(size_t size)
+	{
+		Allocate(size, IndexAlignment);
+		return (Index)((m_block_index * BlockSize + m_offset - size) / IndexAlignment);
+	}
+
+	template<typename T, typename... ArgTypes>
+	inline Index NewIndex(ArgTypes&&... args)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "Arena allocated types are never destructed");
+		static_assert(std::alignment_of<T>::value <= IndexAlignment, "Indexed allocations are only IndexAlignment aligned");
+		const Index index = AllocateIndex(sizeof(T));
+		new(Get<T>(index)) T(std::forward<ArgTypes>(args)...);
+		return index;
+	}
+
+	template<typename T>
+	inline T* Get(Index index) const
+	{
+		const size_t offset = (size_t)index * IndexAlignment;
+		return reinterpret_cast<T*>(m_blocks[offset / BlockSize].get( ) + offset % BlockSize);
+	}
+
+	// Forget everything allocated so far, keeping the blocks for reuse
+	inline void Reset( )
+	{
+		m_block_index = 0;
+		m_head = m_blocks[0].get( );
+		m_offset = 0;
+	}
+
+	inline size_t BytesUsed( ) const
+	{
+		return m_block_index * BlockSize + m_offset;
+	}
+
+	inline size_t BytesReserved( ) const
+	{
+		return m_blocks.size( ) * BlockSize;
+	}
+
+private:
+	void NextBlock( );
+
+	std::vector< std::unique_ptr<uint8_t[]> > m_blocks;
+	uint8_t*	m_head;
+	size_t		m_block_index;
+	size_t		m_offset;
+};
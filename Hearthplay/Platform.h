@@ -0,0 +1,8 @@
+#pragma once
+
+// Differences between the compilers the project builds with. VS2013 has neither alignas nor alignof.
+#if defined(_MSC_VER)
+#define ALIGN_TO(bytes) __declspec(align(bytes))
+#else
+#define ALIGN_TO(bytes) alignas(bytes)
+#endif
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+// Small fast generators for playouts, shuffles and determinization.
+// Anything that takes a generator is templated on its type, so std::mt19937 still works too.
+
+// splitmix64, used to spread a single seed over a generator's whole state
+inline uint64_t SplitMix64(uint64_t& state)
+{
+	uint64_t x = (state += 0x9E3779B97F4A7C15ull);
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+// xoshiro256++ by Blackman and Vigna
+class Xoshiro256pp
+{
+public:
+	typedef uint64_t result_type;
+
+	explicit Xoshiro256pp(uint64_t seed = 0)
+	{
+		Seed(seed);
+	}
+
+	inline void Seed(uint64_t seed)
+	{
+		for (uint64_t& word : m_state)
+		{
+			word = SplitMix64(seed);
+		}
+	}
+
+	inline uint64_t operator()( )
+	{
+		uint64_t result = Rotl(m_state[0] + m_state[3], 23) + m_state[0];
+		uint64_t t = m_state[1] << 17;
+
+		m_state[2] ^= m_state[0];
+		m_state[3] ^= m_state[1];
+		m_state[1] ^= m_state[2];
+		m_state[0] ^= m_state[3];
+		m_state[2] ^= t;
+		m_state[3] = Rotl(m_state[3], 45);
+
+		return result;
+	}
+
+private:
+	static inline uint64_t Rotl(uint64_t x, int k)
+	{
+		return (x << k) | (x >> (64 - k));
+	}
+
+	uint64_t m_state[4];
+};
+
+// pcg32 (XSH RR 64/32) by O'Neill
+class Pcg32
+{
+public:
+	typedef uint32_t result_type;
+
+	explicit Pcg32(uint64_t seed = 0, uint64_t stream = 0)
+	{
+		Seed(seed, stream);
+	}
+
+	inline void Seed(uint64_t seed, uint64_t stream = 0)
+	{
+		m_state = 0;
+		m_increment = (stream << 1) | 1;
+		(*this)( );
+		m_state += seed;
+		(*this)( );
+	}
+
+	inline uint32_t operator()( )
+	{
+		uint64_t old_state = m_state;
+		m_state = old_state * 6364136223846793005ull + m_increment;
+		uint32_t xorshifted = (uint32_t)(((old_state >> 18) ^ old_state) >> 27);
+		uint32_t rot = (uint32_t)(old_state >> 59);
+		return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+	}
+
+private:
+	uint64_t m_state;
+	uint64_t m_increment;
+};
+
+// Philox4x32-10 by Salmon et al. A counter based generator: each block of output is a keyed function of its
+// counter with no state in between, so any block of any stream can be made directly, in any order, on any thread.
+inline void Philox4x32(const uint32_t(&counter)[4], const uint32_t(&key)[2], uint32_t(&out)[4])
+{
+	uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	uint32_t k0 = key[0], k1 = key[1];
+	for (int round = 0; round < 10; ++round)
+	{
+		const uint64_t p0 = 0xD2511F53ull * c0;
+		const uint64_t p1 = 0xCD9E8D57ull * c2;
+		c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+		c1 = (uint32_t)p1;
+		c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+		c3 = (uint32_t)p0;
+		k0 += 0x9E3779B9;
+		k1 += 0xBB67AE85;
+	}
+	out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+// Seed for one independent stream, named by a master seed and up to three numbers, such as what the stream
+// is for and which game it belongs to. Streams named differently are unrelated however close their names.
+inline uint64_t StreamSeed(uint64_t master_seed, uint32_t domain, uint32_t index, uint32_t sub_index = 0)
+{
+	const uint32_t counter[4] = { index, sub_index, domain, 0 };
+	const uint32_t key[2] = { (uint32_t)master_seed, (uint32_t)(master_seed >> 32) };
+	uint32_t out[4];
+	Philox4x32(counter, key, out);
+	return ((uint64_t)out[1] << 32) | out[0];
+}
+
+// 32 random bits from any of the generators. The 64 bit generator gives its high bits, which are the best ones.
+template<typename RandomType>
+inline uint32_t RandomBits32(RandomType& r)
+{
+	return (uint32_t)r( );
+}
+
+inline uint32_t RandomBits32(Xoshiro256pp& r)
+{
+	return (uint32_t)(r( ) >> 32);
+}
+
+// Unbiased random integer in [0, bound), using Lemire's multiply and reject method which
+// only needs a division in the rare case a draw has to be rejected. bound must not be 0.
+template<typename RandomType>
+inline uint32_t RandomBelow(RandomType& r, uint32_t bound)
+{
+	uint64_t m = (uint64_t)RandomBits32(r) * bound;
+	uint32_t low = (uint32_t)m;
+	if (low < bound)
+	{
+		uint32_t threshold = (0u - bound) % bound;
+		while (low < threshold)
+		{
+			m = (uint64_t)RandomBits32(r) * bound;
+			low = (uint32_t)m;
+		}
+	}
+	return (uint32_t)(m >> 32);
+}
+
+// Generator the searches and tournaments use. Swap for Pcg32 or std::mt19937 to compare them.
+typedef Xoshiro256pp Random;
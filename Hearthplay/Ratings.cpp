@@ -0,0 +1,256 @@
+#include "Ratings.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+static const double EloPerNatural = 400.0 / 2.302585092994046; // 400 / ln(10)
+
+// Inverts a symmetric positive definite matrix in place, by Gauss-Jordan elimination
+static void InvertMatrix(std::vector<double>& m, unsigned n)
+{
+	std::vector<double> inverse(n * n, 0.0);
+	for (unsigned i = 0; i < n; ++i)
+	{
+		inverse[i * n + i] = 1.0;
+	}
+
+	for (unsigned col = 0; col < n; ++col)
+	{
+		unsigned pivot = col;
+		for (unsigned row = col + 1; row < n; ++row)
+		{
+			if (fabs(m[row * n + col]) > fabs(m[pivot * n + col]))
+				pivot = row;
+		}
+		if (pivot != col)
+		{
+			std::swap_ranges(m.begin( ) + pivot * n, m.begin( ) + (pivot + 1) * n, m.begin( ) + col * n);
+			std::swap_ranges(inverse.begin( ) + pivot * n, inverse.begin( ) + (pivot + 1) * n, inverse.begin( ) + col * n);
+		}
+
+		const double scale = 1.0 / m[col * n + col];
+		for (unsigned j = 0; j < n; ++j)
+		{
+			m[col * n + j] *= scale;
+			inverse[col * n + j] *= scale;
+		}
+
+		for (unsigned row = 0; row < n; ++row)
+		{
+			const double factor = m[row * n + col];
+			if (row == col || factor == 0.0)
+				continue;
+
+			for (unsigned j = 0; j < n; ++j)
+			{
+				m[row * n + j] -= factor * m[col * n + j];
+				inverse[row * n + j] -= factor * inverse[col * n + j];
+			}
+		}
+	}
+
+	m.swap(inverse);
+}
+
+Ratings::Ratings(unsigned num_players, double prior_elo_sd)
+	: m_num_players(num_players)
+	, m_prior_variance((prior_elo_sd / EloPerNatural) * (prior_elo_sd / EloPerNatural))
+	, m_games(num_players * num_players, 0.0)
+	, m_scores(num_players * num_players, 0.0)
+	, m_strengths(num_players, 0.0)
+	, m_covariance(num_players * num_players, 0.0)
+{
+	for (unsigned i = 0; i < num_players; ++i)
+	{
+		m_covariance[i * num_players + i] = m_prior_variance;
+	}
+}
+
+void Ratings::AddResult(unsigned player_one, unsigned player_two, Winner winner)
+{
+	const double score = winner == Winner::PlayerOne ? 1.0 : winner == Winner::PlayerTwo ? 0.0 : 0.5;
+	m_games[player_one * m_num_players + player_two] += 1.0;
+	m_games[player_two * m_num_players + player_one] += 1.0;
+	m_scores[player_one * m_num_players + player_two] += score;
+	m_scores[player_two * m_num_players + player_one] += 1.0 - score;
+}
+
+void Ratings::Fit( )
+{
+	const unsigned n = m_num_players;
+	std::vector<double> gradient(n);
+	std::vector<double> information(n * n);
+
+	for (int iteration = 0; iteration < 100; ++iteration)
+	{
+		// Gradient and negated Hessian of the log posterior
+		for (unsigned i = 0; i < n; ++i)
+		{
+			gradient[i] = -m_strengths[i] / m_prior_variance;
+			std::fill(information.begin( ) + i * n, information.begin( ) + (i + 1) * n, 0.0);
+			information[i * n + i] = 1.0 / m_prior_variance;
+		}
+		for (unsigned i = 0; i < n; ++i)
+		{
+			for (unsigned j = 0; j < n; ++j)
+			{
+				const double games = m_games[i * n + j];
+				if (i == j || games == 0.0)
+					continue;
+
+				const double p = WinProbability(i, j);
+				gradient[i] += m_scores[i * n + j] - games * p;
+				information[i * n + i] += games * p * (1.0 - p);
+				information[i * n + j] -= games * p * (1.0 - p);
+			}
+		}
+
+		InvertMatrix(information, n);
+		m_covariance = information;
+
+		// Newton step, limited so a player who has won everything closes in on its rating instead of overshooting
+		double largest_step = 0.0;
+		for (unsigned i = 0; i < n; ++i)
+		{
+			double step = 0.0;
+			for (unsigned j = 0; j < n; ++j)
+			{
+				step += m_covariance[i * n + j] * gradient[j];
+			}
+			step = std::max(-2.0, std::min(2.0, step));
+			m_strengths[i] += step;
+			largest_step = std::max(largest_step, fabs(step));
+		}
+
+		if (largest_step < 1e-9)
+			break;
+	}
+}
+
+double Ratings::Elo(unsigned player) const
+{
+	double mean = 0.0;
+	for (double strength : m_strengths)
+	{
+		mean += strength;
+	}
+	mean /= m_num_players;
+	return (m_strengths[player] - mean) * EloPerNatural;
+}
+
+double Ratings::EloError(unsigned player) const
+{
+	return sqrt(CenteredVariance(player)) * EloPerNatural;
+}
+
+uint32_t Ratings::Games(unsigned player) const
+{
+	double games = 0.0;
+	for (unsigned j = 0; j < m_num_players; ++j)
+	{
+		games += m_games[player * m_num_players + j];
+	}
+	return (uint32_t)games;
+}
+
+double Ratings::TotalVariance( ) const
+{
+	double total = 0.0;
+	for (unsigned i = 0; i < m_num_players; ++i)
+	{
+		total += CenteredVariance(i);
+	}
+	return total * EloPerNatural * EloPerNatural;
+}
+
+double Ratings::VarianceReduction(unsigned a, unsigned b) const
+{
+	// A game adds p (1 - p) u u' to the information, where u is +1 for a and -1 for b. By Sherman-Morrison the
+	// covariance then drops by w v v' / (1 + w u' v), with v the covariance times u. The ratings are relative
+	// to the mean, so it's the centered v that counts.
+	const unsigned n = m_num_players;
+	const double p = WinProbability(a, b);
+	const double w = p * (1.0 - p);
+
+	std::vector<double> v(n);
+	double mean = 0.0;
+	for (unsigned i = 0; i < n; ++i)
+	{
+		v[i] = m_covariance[i * n + a] - m_covariance[i * n + b];
+		mean += v[i];
+	}
+	mean /= n;
+
+	double length_squared = 0.0;
+	for (unsigned i = 0; i < n; ++i)
+	{
+		length_squared += (v[i] - mean) * (v[i] - mean);
+	}
+
+	return w * length_squared / (1.0 + w * (v[a] - v[b])) * EloPerNatural * EloPerNatural;
+}
+
+void Ratings::AddPlannedGame(unsigned a, unsigned b)
+{
+	const unsigned n = m_num_players;
+	const double p = WinProbability(a, b);
+	const double w = p * (1.0 - p);
+
+	std::vector<double> v(n);
+	for (unsigned i = 0; i < n; ++i)
+	{
+		v[i] = m_covariance[i * n + a] - m_covariance[i * n + b];
+	}
+
+	const double scale = w / (1.0 + w * (v[a] - v[b]));
+	for (unsigned i = 0; i < n; ++i)
+	{
+		for (unsigned j = 0; j < n; ++j)
+		{
+			m_covariance[i * n + j] -= scale * v[i] * v[j];
+		}
+	}
+}
+
+void Ratings::Print(const char* const* names) const
+{
+	printf("| Player | Elo | 95%% Interval | Games |\n");
+	printf("| ------------- | ------------- | ------------- | ------------- |\n");
+
+	std::vector<unsigned> order(m_num_players);
+	for (unsigned i = 0; i < m_num_players; ++i)
+	{
+		order[i] = i;
+	}
+	std::sort(order.begin( ), order.end( ), [this](unsigned a, unsigned b) { return m_strengths[a] > m_strengths[b]; });
+
+	for (unsigned player : order)
+	{
+		const double elo = Elo(player);
+		const double error = 1.96 * EloError(player);
+		printf("| %s | %.0f | %.0f to %.0f | %u |\n", names[player], elo, elo - error, elo + error, Games(player));
+	}
+}
+
+double Ratings::WinProbability(unsigned a, unsigned b) const
+{
+	return 1.0 / (1.0 + exp(m_strengths[b] - m_strengths[a]));
+}
+
+double Ratings::CenteredVariance(unsigned player) const
+{
+	// Variance of the player's strength less the mean strength
+	const unsigned n = m_num_players;
+	double row = 0.0;
+	double all = 0.0;
+	for (unsigned i = 0; i < n; ++i)
+	{
+		row += m_covariance[player * n + i];
+		for (unsigned j = 0; j < n; ++j)
+		{
+			all += m_covariance[i * n + j];
+		}
+	}
+	return m_covariance[player * n + player] - 2.0 * row / n + all / ((double)n * n);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "GameState.h"
+
+#include <cstdint>
+#include <vector>
+
+// Bradley-Terry ratings of players from the results of the games between them, on the Elo scale, where a player
+// rated 400 above another is expected to score ten times as much against it. Draws count as half a win each.
+//
+// Fit finds the most likely ratings by Newton's method, under a wide normal prior which keeps them finite when
+// one player has won every game. The covariance of the ratings comes from the same fit, and gives each rating's
+// error as well as how much one more game between two players would shrink the errors, for choosing pairings.
+// Ratings are relative to the mean of all the players.
+class Ratings
+{
+public:
+	explicit Ratings(unsigned num_players, double prior_elo_sd = 1000.0);
+
+	unsigned NumPlayers( ) const { return m_num_players; }
+
+	void AddResult(unsigned player_one, unsigned player_two, Winner winner);
+	void Fit( );
+
+	double Elo(unsigned player) const;
+	double EloError(unsigned player) const; // Standard error
+	uint32_t Games(unsigned player) const;
+
+	// Sum of the variances of the ratings, in Elo squared
+	double TotalVariance( ) const;
+
+	// How much one more game between a and b is expected to shrink TotalVariance
+	double VarianceReduction(unsigned a, unsigned b) const;
+
+	// Updates the covariance as though a game between a and b had been played, without changing the ratings,
+	// so a batch of games can be planned before any of them are played
+	void AddPlannedGame(unsigned a, unsigned b);
+
+	void Print(const char* const* names) const;
+
+private:
+	double WinProbability(unsigned a, unsigned b) const;
+	double CenteredVariance(unsigned player) const;
+
+	unsigned m_num_players;
+	double m_prior_variance; // In natural units
+	std::vector<double> m_games; // Between each pair of players, row major
+	std::vector<double> m_scores; // Of the row's player against the column's
+	std::vector<double> m_strengths; // Natural log of each player's strength
+	std::vector<double> m_covariance; // Of the strengths
+};
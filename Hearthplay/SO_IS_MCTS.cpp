@@ -1,234 +1,407 @@
 #include "MCTS.h"
+#include "MCTSCore.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <random>
 
 namespace SO_IS_MCTS
 { 
-	struct MCTSNode
+	// One tree over what the player can see, with the hidden cards guessed again for every iteration
+	typedef MCTSCore::Core<MCTSCore::IterationDeterminization, MCTSCore::AvailabilityUCB1, MCTSNode> Core;
+
+	struct SharedMCTSNode;
+
+	// A run of children of a node in the tree parallel search, with their statistics side by side. Chunks are
+	// linked into a list which only ever grows, and each slot is claimed by one thread, which fills it in and
+	// then publishes the child's node. Readers skip slots whose node isn't published yet.
+	struct SharedChildChunk
 	{
-		MCTSNode* m_parent;
-		Move m_move; // The move that got us here from parent
-
-		MCTSNode* m_child;
-		MCTSNode* m_siblings;
-
-		uint32_t m_visits;
-		uint32_t m_wins;
-		uint32_t m_availability; // How often this node was available when its parent was visited
-
-		MCTSNode()
-			: m_parent(nullptr)
-			, m_move(Move::EndTurn( ))
-			, m_child(nullptr)
-			, m_siblings(nullptr)
-			, m_visits(0)
-			, m_wins(0)
-			, m_availability(0)
+		static const unsigned Width = 16;
+
+		std::atomic<uint32_t>	m_wins[Width];
+		std::atomic<uint32_t>	m_visits[Width];
+		std::atomic<uint32_t>	m_availability[Width];
+		std::atomic<uint32_t>	m_virtual_loss[Width];
+		std::atomic<SharedMCTSNode*> m_nodes[Width];
+		Move					m_moves[Width];
+		MoveId					m_ids[Width];
+		std::atomic<SharedChildChunk*> m_next;
+
+		SharedChildChunk()
+			: m_next(nullptr)
 		{
+			for (unsigned i = 0; i < Width; ++i)
+			{
+				m_wins[i].store(0, std::memory_order_relaxed);
+				m_visits[i].store(0, std::memory_order_relaxed);
+				m_availability[i].store(0, std::memory_order_relaxed);
+				m_virtual_loss[i].store(0, std::memory_order_relaxed);
+				m_nodes[i].store(nullptr, std::memory_order_relaxed);
+			}
 		}
+	};
+
+	const unsigned SharedChildChunk::Width;
 
-		MCTSNode(MCTSNode* parent, Move m)
+	// Node for the tree parallel search. The statistics of a node are kept in its parent's chunks, and are
+	// atomic. Every thread whose path runs through a node holds a virtual loss on it until it backs up its
+	// result, which steers other threads towards different children. Nodes span the arenas of all the
+	// threads, so they link with pointers rather than indices.
+	struct SharedMCTSNode
+	{
+		SharedMCTSNode* m_parent;
+		SharedChildChunk* m_parent_chunk;
+		uint8_t m_parent_slot; // Within m_parent_chunk
+
+		std::atomic<SharedChildChunk*> m_chunks;
+		std::atomic<uint32_t> m_num_claimed; // Child slots handed out, some of which may not be published yet
+
+		// A MoveSet of the moves of every child. A thread claims a move by setting its bit, so each move
+		// is only expanded once.
+		std::atomic<uint64_t> m_tried[MoveSet::NumWords];
+
+		SharedMCTSNode(SharedMCTSNode* parent = nullptr, SharedChildChunk* parent_chunk = nullptr, uint8_t parent_slot = 0)
 			: m_parent(parent)
-			, m_move(m)
-			, m_child(nullptr)
-			, m_siblings(nullptr)
-			, m_visits(0)
-			, m_wins(0)
-			, m_availability(0)
+			, m_parent_chunk(parent_chunk)
+			, m_parent_slot(parent_slot)
+			, m_chunks(nullptr)
+			, m_num_claimed(0)
 		{
+			for (std::atomic<uint64_t>& word : m_tried)
+			{
+				word.store(0, std::memory_order_relaxed);
+			}
 		}
 
-		inline auto GetUntriedMoves(const GameState& game) -> decltype(GameState::m_possible_moves)
+		// Returns false if every legal move has been tried
+		inline bool ChooseRandomUntriedMove(const GameState& game, Random& r, Move& out_move) const
 		{
-			auto moves = game.m_possible_moves;
-			for (MCTSNode* node = m_child; node; node = node->m_siblings)
+			uint64_t untried[MoveSet::NumWords];
+			unsigned num_untried = 0;
+			for (unsigned i = 0; i < MoveSet::NumWords; ++i)
 			{
-				decltype(moves.Num()) idx;
-				if (moves.Find(node->m_move, idx))
+				untried[i] = game.m_legal_moves.Word(i) & ~m_tried[i].load(std::memory_order_relaxed);
+				num_untried += PopCount64(untried[i]);
+			}
+			if (num_untried == 0)
+			{
+				return false;
+			}
+
+			unsigned n = RandomBelow(r, num_untried);
+			for (unsigned i = 0; ; ++i)
+			{
+				const unsigned in_word = PopCount64(untried[i]);
+				if (n < in_word)
 				{
-					moves.RemoveSwap(idx);
+					out_move = GetMove((MoveId)(i * 64 + NthSetBit64(untried[i], n)));
+					return true;
 				}
+				n -= in_word;
 			}
-			return moves;
-		}
-
-		inline bool HasUntriedMoves(const GameState& game)
-		{
-			return GetUntriedMoves(game).Num() > 0;
 		}
 
-		inline bool HasChildren()
+		// Picks a random untried move and claims it for this thread. Returns false if every legal move has been tried.
+		inline bool ClaimRandomUntriedMove(const GameState& game, Random& r, Move& out_move)
 		{
-			return m_child != nullptr;
+			while (ChooseRandomUntriedMove(game, r, out_move))
+			{
+				const MoveId id = GetMoveId(out_move);
+				const uint64_t bit = 1ull << (id & 63);
+				if (!(m_tried[id >> 6].fetch_or(bit, std::memory_order_relaxed) & bit))
+				{
+					return true;
+				}
+			}
+			return false;
 		}
 
-		inline MCTSNode* UCTSelectChild( const GameState& state )
+		// Returns nullptr if none of the published children are legal in this determinization
+		inline SharedMCTSNode* UCTSelectChild(const GameState& state) const
 		{
-			MCTSNode* best_child = nullptr;
+			SharedMCTSNode* best_child = nullptr;
 			float best_score = -1.0f;
 
-			for (MCTSNode* node = m_child; node; node = node->m_siblings)
+			const uint32_t num_claimed = m_num_claimed.load(std::memory_order_relaxed);
+			uint32_t first = 0;
+			for (SharedChildChunk* chunk = m_chunks.load(std::memory_order_acquire); chunk && first < num_claimed; chunk = chunk->m_next.load(std::memory_order_acquire), first += SharedChildChunk::Width)
 			{
-				if (!state.m_possible_moves.Contains(node->m_move))
+				const unsigned num = std::min(num_claimed - first, SharedChildChunk::Width);
+				uint32_t wins[SharedChildChunk::Width];
+				uint32_t visits[SharedChildChunk::Width];
+				uint32_t availability[SharedChildChunk::Width];
+				bool usable[SharedChildChunk::Width];
+				for (unsigned i = 0; i < num; ++i)
 				{
-					continue;
+					usable[i] = chunk->m_nodes[i].load(std::memory_order_acquire) && state.m_legal_moves.Contains(chunk->m_ids[i]);
+
+					// Virtual losses count as visits that were lost
+					wins[i] = chunk->m_wins[i].load(std::memory_order_relaxed);
+					visits[i] = std::max(chunk->m_visits[i].load(std::memory_order_relaxed) + chunk->m_virtual_loss[i].load(std::memory_order_relaxed), 1u);
+					availability[i] = std::max(chunk->m_availability[i].load(std::memory_order_relaxed), 1u);
 				}
 
-				float score = (node->m_wins / (float)node->m_visits)
-					+ (float)sqrtf(log((float)node->m_availability) / node->m_visits); // TODO tiebreak?
-				if (score > best_score)
+				float scores[SharedChildChunk::Width];
+				UCTScores(wins, visits, availability, num, scores);
+				for (unsigned i = 0; i < num; ++i)
 				{
-					best_child = node;
-					best_score = score;
+					scores[i] = usable[i] ? scores[i] : -1.0f;
+				}
+
+				const unsigned best = BestScore(scores, num);
+				if (scores[best] > best_score)
+				{
+					best_child = chunk->m_nodes[best].load(std::memory_order_relaxed);
+					best_score = scores[best];
 				}
 			}
 
 			return best_child;
 		}
 
-		inline Move ChooseRandomUntriedMove(const GameState& game, std::mt19937& r)
-		{
-			auto moves = GetUntriedMoves(game);
-			std::uniform_int_distribution< decltype(GameState::m_possible_moves)::SizeType > dist(0, moves.Num() - 1);
-			return moves[dist(r)];
-		}
-
-		inline MCTSNode* AddChild(Move m, MCTSNode* store)
+		inline void UpdateAvailability(const GameState& state)
 		{
-			MCTSNode* new_node = new(store) MCTSNode(this, m); // TODO placement
-			if (m_child == nullptr)
+			const uint32_t num_claimed = m_num_claimed.load(std::memory_order_relaxed);
+			uint32_t first = 0;
+			for (SharedChildChunk* chunk = m_chunks.load(std::memory_order_acquire); chunk && first < num_claimed; chunk = chunk->m_next.load(std::memory_order_acquire), first += SharedChildChunk::Width)
 			{
-				m_child = new_node;
-			}
-			else
-			{
-				for (MCTSNode* node = m_child; node; node = node->m_siblings)
+				const unsigned num = std::min(num_claimed - first, SharedChildChunk::Width);
+				for (unsigned i = 0; i < num; ++i)
 				{
-					if (node->m_siblings == nullptr)
+					if (chunk->m_nodes[i].load(std::memory_order_acquire) && state.m_legal_moves.Contains(chunk->m_ids[i]))
 					{
-						node->m_siblings = new_node;
-						break;
+						chunk->m_availability[i].fetch_add(1, std::memory_order_relaxed);
 					}
 				}
 			}
-			return new_node;
 		}
-	};
-
-	static GameState Determinize(const GameState& game, std::mt19937& r)
-	{
-		GameState new_state(game);
-
-		int8_t opponent_idx = (int8_t)abs(new_state.m_active_player_index - 1);
-		Player& active = new_state.m_players[new_state.m_active_player_index];
-		Player& opponent = new_state.m_players[opponent_idx];
-
-		std::uniform_int_distribution<uint32_t> hand_distribution(0, DeckPossibleCards.size());
-		std::uniform_int_distribution<uint32_t> deck_distribution(0, DeckPossibleCards.size() - 1);
 
-		// Randomize cards in opponent's hand
-		for (uint8_t i = 0; i < opponent.m_hand.Num(); ++i)
+		// Adds the child for a move this thread claimed. It starts with this thread's virtual loss, so it never
+		// has zero visits, and has been available once.
+		inline SharedMCTSNode* AddChild(Move m, NodeArena& arena)
 		{
-			auto idx = hand_distribution(r);
-			Card c = idx == DeckPossibleCards.size() ? Card::Coin : DeckPossibleCards[idx];
-			opponent.m_hand[i] = c;
+			const uint32_t slot = m_num_claimed.fetch_add(1, std::memory_order_relaxed);
+			SharedChildChunk* chunk = Chunk(slot / SharedChildChunk::Width, arena);
+			const uint8_t index = (uint8_t)(slot % SharedChildChunk::Width);
+
+			chunk->m_moves[index] = m;
+			chunk->m_ids[index] = GetMoveId(m);
+			chunk->m_availability[index].store(1, std::memory_order_relaxed);
+			chunk->m_virtual_loss[index].store(1, std::memory_order_relaxed);
+			SharedMCTSNode* new_node = arena.New<SharedMCTSNode>(this, chunk, index);
+			chunk->m_nodes[index].store(new_node, std::memory_order_release);
+			return new_node;
 		}
 
-		// Shuffle my deck
-		active.m_deck.Shuffle(r);
-
-		// Randomize opponent's deck
-		for (uint8_t i = 0; i < opponent.m_deck.Num(); ++i)
+		// Returns the nth chunk, adding any that are missing
+		inline SharedChildChunk* Chunk(uint32_t n, NodeArena& arena)
 		{
-			Card c = DeckPossibleCards[deck_distribution(r)];
-			opponent.m_deck[i] = c;
+			std::atomic<SharedChildChunk*>* link = &m_chunks;
+			for (;;)
+			{
+				SharedChildChunk* chunk = link->load(std::memory_order_acquire);
+				if (!chunk)
+				{
+					// The loser of a race leaves its chunk unused in its arena
+					SharedChildChunk* new_chunk = arena.New<SharedChildChunk>( );
+					chunk = link->compare_exchange_strong(chunk, new_chunk, std::memory_order_acq_rel, std::memory_order_acquire) ? new_chunk : chunk;
+				}
+
+				if (n-- == 0)
+				{
+					return chunk;
+				}
+				link = &chunk->m_next;
+			}
 		}
 
-		// This should not have actually changed the possible moves, but just to be safe against future changes
-		new_state.UpdatePossibleMoves();
+		inline Move MoveFromParent( ) const
+		{
+			return m_parent_chunk->m_moves[m_parent_slot];
+		}
+	};
 
-		return new_state;
+	Move ChooseMove(const GameState& game, const SearchBudget& budget, uint64_t seed, unsigned* out_iterations)
+	{
+		const SearchLimit limit(budget, HighResClock::now( ));
+		Random r(seed);
+		NodeArena arena;
+
+		MCTSCore::NoTranspositions<MCTSNode> no_transpositions;
+		std::vector<PathStep> path;
+		UndoJournal journal;
+		const NodeArena::Index root = Core::NewRoot(arena, no_transpositions, game);
+		const unsigned iterations = Core::RunIterations(root, game, limit, arena, no_transpositions, path, journal, r);
+		if (out_iterations)
+			*out_iterations = iterations;
+		return Core::MostVisitedMove(root, arena, game);
 	}
 
-	Move ChooseMove(const GameState& game, unsigned iterations)
+	Move ChooseMove(const GameState& game, const SearchBudget& budget, unsigned num_threads, uint64_t seed, unsigned* out_iterations)
 	{
-		std::mt19937 r(GlobalRandomDevice());
-		MCTSNode root;
-
-		MCTSNode* store = (MCTSNode*)malloc(sizeof(MCTSNode) * iterations);
-		MCTSNode* store_head = store;
-
-		for (unsigned iter = 0; iter < iterations; ++iter)
+		const SearchLimit limit(budget, HighResClock::now( ));
+		ThreadPool& pool = ThreadPool::Shared( );
+		num_threads = std::min(std::max(num_threads, 1u), pool.NumThreads( ));
+
+		// Threads allocate nodes from arenas of their own, so the root lives here. A thread can pick up more
+		// than one job, and keeps adding to the same arena.
+		std::unique_ptr<NodeArena[]> arenas(new NodeArena[num_threads]);
+		SharedMCTSNode root;
+		std::atomic<unsigned> next_iteration(0);
+		std::atomic<unsigned> iterations_run(0);
+		std::atomic<bool> out_of_time(false);
+
+		pool.ParallelFor(num_threads, num_threads, [&](unsigned job, unsigned thread_index)
 		{
-			GameState sim_state = Determinize(game, r);
+			Random r(StreamSeed(seed, 0, job));
+			NodeArena& arena = arenas[thread_index];
 
-			// Selection
-			MCTSNode* node = &root;
-			while (!node->HasUntriedMoves(sim_state) && node->HasChildren())
+			GameState sim_state(game);
+			UndoJournal journal;
+			const UndoJournal::Mark start = journal.GetMark( );
+
+			// Iterations are handed out across the threads, and each checks the clock every so many of its own.
+			// The first to see the deadline pass stops the rest.
+			unsigned own_iterations = 0;
+			while (!out_of_time.load(std::memory_order_relaxed) && next_iteration.fetch_add(1, std::memory_order_relaxed) < limit.m_iterations)
 			{
-				MCTSNode* next_node = node->UCTSelectChild(sim_state);
+				if (limit.Done(own_iterations))
+				{
+					out_of_time.store(true, std::memory_order_relaxed);
+					break;
+				}
+				++own_iterations;
 
-				// Update availability
-				for (MCTSNode* avail_node = node->m_child; avail_node; avail_node = avail_node->m_siblings)
+				MCTSCore::Determinize(sim_state, r, &journal);
+
+				// Selection
+				SharedMCTSNode* node = &root;
+				for (;;)
 				{
-					if (sim_state.m_possible_moves.Contains(avail_node->m_move))
+					Move m;
+					if (node->ClaimRandomUntriedMove(sim_state, r, m))
 					{
-						avail_node->m_availability++;
+						// Expansion
+
+						node->UpdateAvailability(sim_state);
+						sim_state.ProcessMove(m, &journal);
+						node = node->AddChild(m, arena);
+						break;
 					}
+
+					SharedMCTSNode* next_node = node->UCTSelectChild(sim_state);
+					if (!next_node)
+						break;
+
+					node->UpdateAvailability(sim_state);
+					next_node->m_parent_chunk->m_virtual_loss[next_node->m_parent_slot].fetch_add(1, std::memory_order_relaxed);
+					sim_state.ProcessMove(next_node->MoveFromParent( ), &journal);
+					node = next_node;
 				}
 
-				sim_state.ProcessMove(next_node->m_move);
-				node = next_node;
+				// Simulation
+				GameStateCore playout_state(sim_state);
+				playout_state.PlayOutRandomly(r);
+
+				// Backpropagation
+				bool won = playout_state.m_winner == (Winner)game.m_active_player_index;
+				journal.RollBack(start);
+				for (; node->m_parent; node = node->m_parent)
+				{
+					SharedChildChunk* chunk = node->m_parent_chunk;
+					chunk->m_visits[node->m_parent_slot].fetch_add(1, std::memory_order_relaxed);
+					if (won) chunk->m_wins[node->m_parent_slot].fetch_add(1, std::memory_order_relaxed);
+					chunk->m_virtual_loss[node->m_parent_slot].fetch_sub(1, std::memory_order_relaxed);
+				}
 			}
-		
-			// Expansion
-			if (node->HasUntriedMoves(sim_state))
+			iterations_run.fetch_add(own_iterations, std::memory_order_relaxed);
+		});
+
+		// Every thread has finished, so all the claimed children are published
+		Move best_move = Move::EndTurn( );
+		uint32_t best_visits = 0;
+		const uint32_t num_children = root.m_num_claimed.load( );
+		uint32_t first = 0;
+		for (SharedChildChunk* chunk = root.m_chunks.load( ); chunk && first < num_children; chunk = chunk->m_next.load( ), first += SharedChildChunk::Width)
+		{
+			const unsigned num = std::min(num_children - first, SharedChildChunk::Width);
+			for (unsigned i = 0; i < num; ++i)
 			{
-				Move m = node->ChooseRandomUntriedMove(sim_state, r);
-				for (MCTSNode* avail_node = node->m_child; avail_node; avail_node = avail_node->m_siblings)
+				uint32_t visits = chunk->m_visits[i].load( );
+				if (visits > best_visits && game.m_legal_moves.Contains(chunk->m_ids[i]))
 				{
-					if (sim_state.m_possible_moves.Contains(avail_node->m_move))
-					{
-						avail_node->m_availability++;
-					}
+					best_visits = visits;
+					best_move = chunk->m_moves[i];
 				}
-
-				sim_state.ProcessMove(m);
-				node = node->AddChild(m, store_head);
-				store_head += 1;
-				node->m_availability++;
 			}
+		}
 
-			// Simulation
-			sim_state.PlayOutRandomly(r);
-		
-			// Backpropagation
-			bool won = sim_state.m_winner == (Winner)game.m_active_player_index;
-			while (node)
-			{
-				node->m_visits++;
-				if (won) node->m_wins++;
+		if (out_iterations)
+			*out_iterations = iterations_run.load( );
+		return best_move;
+	}
 
-				node = node->m_parent;
-			}
+	Search::Search(const SearchBudget& budget)
+		: m_arena_index(0)
+		, m_root(NodeArena::NoIndex)
+		, m_root_moved(false)
+		, m_budget(budget)
+		, m_random(GlobalRandomDevice( ))
+	{
+	}
+
+	void Search::Reset( )
+	{
+		m_root = NodeArena::NoIndex;
+		m_root_moved = false;
+	}
+
+	void Search::Seed(uint64_t seed)
+	{
+		m_random = Random(seed);
+	}
+
+	void Search::MovePlayed(const Move& m)
+	{
+		if (m_root != NodeArena::NoIndex)
+		{
+			const NodeArena& arena = m_arenas[m_arena_index];
+			m_root = arena.Get<MCTSNode>(m_root)->FindChild(arena, m);
+			m_root_moved = true;
 		}
+	}
 
-		MCTSNode* best_node = nullptr;
-		uint32_t best_visits = 0;
+	Move Search::ChooseMove(const GameState& game, unsigned* out_iterations)
+	{
+		// Compacting the tree counts against the time too
+		const SearchLimit limit(m_budget, HighResClock::now( ));
+		Random& r = m_random;
 
-		for (MCTSNode* node = root.m_child; node; node = node->m_siblings)
+		if (m_root != NodeArena::NoIndex && m_root_moved)
 		{
-			if (node->m_visits > best_visits)
-			{
-				best_visits = node->m_visits;
-				best_node = node;
-			}
+			// Copy the subtree we kept into the other arena so everything else can be thrown away at once
+			NodeArena& to = m_arenas[m_arena_index ^ 1];
+			to.Reset( );
+			MCTSCore::NoTranspositions<MCTSNode> no_transpositions;
+			m_root = Core::CopyGraph(m_root, m_arenas[m_arena_index], to, no_transpositions, m_copy_stack);
+			m_arena_index ^= 1;
 		}
+		m_root_moved = false;
 
-		Move m = best_node->m_move;
-		free(store);
-		return m;
-	}
+		NodeArena& arena = m_arenas[m_arena_index];
+		MCTSCore::NoTranspositions<MCTSNode> no_transpositions;
+		if (m_root == NodeArena::NoIndex)
+		{
+			arena.Reset( );
+			m_root = Core::NewRoot(arena, no_transpositions, game);
+		}
 
+		const unsigned iterations = Core::RunIterations(m_root, game, limit, arena, no_transpositions, m_path, m_journal, r);
+		if (out_iterations)
+			*out_iterations = iterations;
+		return Core::MostVisitedMove(m_root, arena, game);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include "SPRT.h"
+
+#include <cmath>
+
+SPRT::SPRT(double elo0, double elo1, double alpha, double beta)
+	: m_elo0(elo0)
+	, m_elo1(elo1)
+	, m_alpha(alpha)
+	, m_beta(beta)
+{
+}
+
+double SPRT::LowerBound( ) const
+{
+	return log(m_beta / (1.0 - m_alpha));
+}
+
+double SPRT::UpperBound( ) const
+{
+	return log((1.0 - m_beta) / m_alpha);
+}
+
+double SPRT::LogLikelihoodRatio(uint32_t wins, uint32_t draws, uint32_t losses) const
+{
+	const double w = wins + 1.0;
+	const double d = draws;
+	const double l = losses + 1.0;
+	const double n = w + d + l;
+
+	const double score = (w + 0.5 * d) / n;
+	const double variance = (w * (1.0 - score) * (1.0 - score) + d * (0.5 - score) * (0.5 - score) + l * score * score) / n;
+
+	const double score0 = EloToScore(m_elo0);
+	const double score1 = EloToScore(m_elo1);
+	return n * (score1 - score0) * (2.0 * score - score0 - score1) / (2.0 * variance);
+}
+
+SPRT::Result SPRT::Test(uint32_t wins, uint32_t draws, uint32_t losses) const
+{
+	const double llr = LogLikelihoodRatio(wins, draws, losses);
+	if (llr >= UpperBound( ))
+		return Result::AcceptH1;
+	if (llr <= LowerBound( ))
+		return Result::AcceptH0;
+	return Result::Continue;
+}
+
+double SPRT::EloToScore(double elo)
+{
+	return 1.0 / (1.0 + pow(10.0, -elo / 400.0));
+}
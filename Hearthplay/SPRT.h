@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+// Sequential probability ratio test of whether one player is stronger than another, for stopping a match as
+// soon as its result is clear. H0 is that the first player's Elo advantage is m_elo0, H1 that it's m_elo1,
+// and alpha and beta are the chances of wrongly accepting H1 and H0. After every game the log likelihood ratio
+// of the results is compared with bounds made from alpha and beta.
+//
+// The ratio is the normal approximation to the trinomial one, as used by Fishtest. One pseudo win and one pseudo
+// loss are added to the counts, so a match where one player wins every game still has a variance, and stops.
+struct SPRT
+{
+	enum class Result
+	{
+		Continue,
+		AcceptH0,
+		AcceptH1
+	};
+
+	double m_elo0;
+	double m_elo1;
+	double m_alpha;
+	double m_beta;
+
+	SPRT(double elo0 = 0.0, double elo1 = 50.0, double alpha = 0.05, double beta = 0.05);
+
+	double LowerBound( ) const;
+	double UpperBound( ) const;
+
+	double LogLikelihoodRatio(uint32_t wins, uint32_t draws, uint32_t losses) const;
+	Result Test(uint32_t wins, uint32_t draws, uint32_t losses) const;
+
+	// Expected score of a player with this Elo advantage
+	static double EloToScore(double elo);
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Clock.h"
+
+#include <climits>
+
+// How much searching an engine may do for one move: a number of iterations, or a wall clock time.
+// Converts from a plain iteration count, so existing callers keep working.
+struct SearchBudget
+{
+	unsigned m_iterations;
+	HighResClock::duration m_time; // Zero for no time limit
+
+	SearchBudget(unsigned iterations)
+		: m_iterations(iterations)
+		, m_time(0)
+	{
+	}
+
+	static SearchBudget Time(HighResClock::duration time)
+	{
+		SearchBudget budget(UINT_MAX);
+		budget.m_time = time;
+		return budget;
+	}
+
+	bool IsTimed( ) const
+	{
+		return m_time.count( ) > 0;
+	}
+};
+
+// A budget fixed to a deadline, once the search has started
+struct SearchLimit
+{
+	// Reading the clock costs far less than an iteration, but there's no point doing it after every one
+	static const unsigned ClockCheckInterval = 16;
+
+	unsigned m_iterations;
+	bool m_timed;
+	HighResClock::time_point m_deadline;
+
+	SearchLimit(const SearchBudget& budget, HighResClock::time_point start)
+		: m_iterations(budget.m_iterations)
+		, m_timed(budget.IsTimed( ))
+		, m_deadline(start + budget.m_time)
+	{
+	}
+
+	// Whether a search which has run this many iterations should stop. At least one iteration is always allowed,
+	// so a search has a move to return however short its time. The clock is read after the first iteration too,
+	// so a search which starts with no time left, like a late determinization, stops there.
+	bool Done(unsigned iterations) const
+	{
+		if (iterations >= m_iterations)
+			return true;
+
+		return m_timed && (iterations == 1 || (iterations > 0 && iterations % ClockCheckInterval == 0)) && HighResClock::now( ) >= m_deadline;
+	}
+
+	// The limit for one of parts searches run one after another, which share the time left evenly
+	SearchLimit Slice(HighResClock::time_point now, unsigned parts) const
+	{
+		SearchLimit slice(*this);
+		if (m_timed && now < m_deadline)
+		{
+			slice.m_deadline = now + (m_deadline - now) / parts;
+		}
+		return slice;
+	}
+};
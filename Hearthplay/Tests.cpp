@@ -1,8 +1,20 @@
 #include "Tests.h"
 #include "GameState.h"
 #include "Cards.h"
-
+#include "TranspositionTable.h"
+#include "MCTS.h"
+#include "UCT.h"
+#include "Clock.h"
+#include "Tournament.h"
+#include "GameLog.h"
+#include "Ratings.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
 #include <string>
+#include <tuple>
 
 #define STRINGIZE(x) STRINGIZE2(x)
 #define STRINGIZE2(x) #x
@@ -10,7 +22,7 @@
 
 #define CHECK( foo ) \
 if( !(foo) ) { \
-	printf( "Check failed(" LINE_STRING "): " ## #foo "\n" ); \
+	printf( "Check failed(" LINE_STRING "): " #foo "\n" ); \
 	return false;\
 }
 
@@ -23,7 +35,7 @@ if( !(foo) ) { \
 #define CHECK_DO_MOVE( move ) \
 	CHECK( ProcessMove(g, move) )
 
-Minion& AddMinion(GameState& g, uint8_t player, Card c)
+MinionRef AddMinion(GameState& g, uint8_t player, Card c)
 {
 	const CardData* data = GetCardData(c);
 	Minion m{ data };
@@ -31,9 +43,9 @@ Minion& AddMinion(GameState& g, uint8_t player, Card c)
 	return g.m_players[player].m_minions[idx];
 }
 
-Minion& AddMinionReadyToAttack(GameState& g, uint8_t player, Card c)
+MinionRef AddMinionReadyToAttack(GameState& g, uint8_t player, Card c)
 {
-	Minion& m = AddMinion(g, player, c);
+	MinionRef m = AddMinion(g, player, c);
 	m.m_flags &= ~(MinionFlags::AttackedThisTurn | MinionFlags::SummonedThisTurn);
 	return m;
 }
@@ -74,7 +86,7 @@ bool MovePossible(const GameState& g, Move m)
 	return g.m_possible_moves.Contains(m);
 }
 
-Minion& GetMinion(GameState& g, uint8_t player_idx, uint8_t minion_idx)
+MinionRef GetMinion(GameState& g, uint8_t player_idx, uint8_t minion_idx)
 {
 	return g.m_players[player_idx].m_minions[minion_idx];
 }
@@ -89,6 +101,76 @@ int8_t GetPlayerHealth(const GameState& g, uint8_t player_idx)
 	return g.m_players[player_idx].m_health;
 }
 
+template<typename T, unsigned Capacity, typename SizeType>
+bool SameContents(const FixedVector<T, Capacity, SizeType>& a, const FixedVector<T, Capacity, SizeType>& b)
+{
+	if (a.Num( ) != b.Num( ))
+		return false;
+
+	for (SizeType i = 0; i < a.Num( ); ++i)
+	{
+		if (!(a[i] == b[i]))
+			return false;
+	}
+	return true;
+}
+
+bool SameMinion(const Minion& a, const Minion& b)
+{
+	if (a.m_attack != b.m_attack || a.m_health != b.m_health || a.m_max_health != b.m_max_health
+		|| a.m_spelldamage != b.m_spelldamage || a.m_source_card != b.m_source_card
+		|| a.m_abilities != b.m_abilities || a.m_flags != b.m_flags)
+	{
+		return false;
+	}
+	return memcmp(a.m_aura_totals, b.m_aura_totals, sizeof(a.m_aura_totals)) == 0;
+}
+
+// Compares everything a move can change. Unused elements of fixed vectors are allowed to differ.
+bool SameState(const GameState& a, const GameState& b)
+{
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		const Player& pa = a.m_players[i];
+		const Player& pb = b.m_players[i];
+		if (pa.m_health != pb.m_health || pa.m_max_mana != pb.m_max_mana || pa.m_mana != pb.m_mana
+			|| pa.m_minions.Num( ) != pb.m_minions.Num( ) || !SameContents(pa.m_hand, pb.m_hand) || !SameContents(pa.m_deck, pb.m_deck))
+		{
+			return false;
+		}
+
+		for (uint8_t m = 0; m < pa.m_minions.Num( ); ++m)
+		{
+			if (!SameMinion(pa.m_minions[m], pb.m_minions[m]))
+				return false;
+		}
+	}
+	return a.m_active_player_index == b.m_active_player_index
+		&& a.m_winner == b.m_winner
+		&& a.m_hash == b.m_hash
+		&& SameContents(a.m_possible_moves, b.m_possible_moves);
+}
+
+GameState RandomGame(Random& r)
+{
+	GameState g;
+	for (uint8_t player = 0; player < 2; ++player)
+	{
+		for (uint8_t i = 0; i < 30; ++i)
+		{
+			AddCardToDeck(g, player, DeckPossibleCards[RandomBelow(r, (uint32_t)DeckPossibleCards.size( ))]);
+		}
+		for (uint8_t i = 0; i < 4; ++i)
+		{
+			g.m_players[player].DrawOne( );
+		}
+	}
+	AddCard(g, 1, Card::Coin);
+	SetManaAndMax(g, 0, 1);
+	g.UpdatePossibleMoves( );
+	return g;
+}
+
 typedef bool(*TestFunc)();
 
 struct TestCase
@@ -414,7 +496,7 @@ TestCase Tests[] =
 			CHECK(g.m_active_player_index == 0);
 			CHECK_DO_MOVE(Move::PlayCard(Card::BloodfenRaptor));
 			CHECK(GetNumMinions(g, 0) == 1);
-			CHECK(GetMinion(g,0,0).m_source_card == GetCardData(Card::BloodfenRaptor));
+			CHECK(GetMinion(g,0,0).m_source_card == Card::BloodfenRaptor);
 			CHECK(GetMinion(g,0,0).m_attack == 3);
 			CHECK(GetMinion(g,0,0).m_health == 2);
 			CHECK(GetMinion(g,0,0).CanAttack( ) == false);
@@ -529,7 +611,7 @@ TestCase Tests[] =
 			CHECK(g.m_active_player_index == 0);
 			CHECK_DO_MOVE(Move::PlayCard(Card::ElvenArcher, Move::TargetMinion(0, 0)));
 			CHECK(GetNumMinions(g, 0) == 2);
-			CHECK(GetMinion(g,0,0).m_source_card == GetCardData(Card::BloodfenRaptor));
+			CHECK(GetMinion(g,0,0).m_source_card == Card::BloodfenRaptor);
 			CHECK(GetMinion(g,0,0).m_health == 1);
 
 			return true;
@@ -547,7 +629,7 @@ TestCase Tests[] =
 			CHECK(g.m_active_player_index == 0);
 			CHECK_DO_MOVE(Move::PlayCard(Card::ElvenArcher, Move::TargetMinion(0, 0)));
 			CHECK(GetNumMinions(g, 0) == 1);
-			CHECK(GetMinion(g,0,0).m_source_card == GetCardData(Card::ElvenArcher));
+			CHECK(GetMinion(g,0,0).m_source_card == Card::ElvenArcher);
 
 			return true;
 		}
@@ -731,6 +813,24 @@ TestCase Tests[] =
 			return true;
 		}
 	},
+	{
+		"Abusive Sergeant on empty board gives nothing an aura", []( )
+		{
+			GameState g;
+			AddCard(g, 0, Card::AbusiveSergeant);
+			SetManaAndMax(g, 0, 1);
+			AddCard(g, 1, Card::BloodfenRaptor);
+			g.UpdatePossibleMoves( );
+
+			CHECK_DO_MOVE(Move::PlayCard(Card::AbusiveSergeant));
+			CHECK(GetNumMinions(g, 0) == 1);
+			CHECK(GetMinion(g, 0, 0).m_attack == GetCardData(Card::AbusiveSergeant)->m_attack);
+			CHECK(GetNumMinions(g, 1) == 0);
+			CHECK(g.m_players[1].m_hand.Num( ) == 1);
+
+			return true;
+		}
+	},
 	{
 		"Minion affected by Abusive Sergeant does more damage", []( )
 		{
@@ -748,6 +848,60 @@ TestCase Tests[] =
 			return true;
 		}
 	},
+	{
+		"Minion board removes dead minions and keeps the rest in order", []( )
+		{
+			GameState g;
+			AddMinion(g, 0, Card::BloodfenRaptor);
+			AddMinion(g, 0, Card::KoboldGeomancer);
+			AddMinion(g, 0, Card::SenjinShieldMasta);
+			AddMinion(g, 0, Card::MurlocRaider);
+
+			MinionBoard& board = g.m_players[0].m_minions;
+			CHECK(board.TotalSpelldamage( ) == 1);
+			CHECK(board.TauntMask( ) == 0x4);
+			board.DamageAll(2);
+			CHECK(board.DeadMask( ) == 0xB);
+
+			board.RemoveMask(board.DeadMask( ));
+			CHECK(board.Num( ) == 1);
+			CHECK(board.TauntMask( ) == 1);
+			CHECK(board.TotalSpelldamage( ) == 0);
+			CHECK(board.CachesMatch( ));
+			CHECK(board[0].m_source_card == Card::SenjinShieldMasta);
+			CHECK(board[0].m_health == GetCardData(Card::SenjinShieldMasta)->m_health - 2);
+			CHECK(board.DeadMask( ) == 0);
+
+			board.HealAll(5);
+			CHECK(board[0].m_health == GetCardData(Card::SenjinShieldMasta)->m_health);
+			CHECK(board.AbilityMask(MinionAbilityFlags::Taunt) == 1);
+
+			return true;
+		}
+	},
+	{
+		"Stacked auras wear off together at end of turn", []( )
+		{
+			GameState g;
+			AddCard(g, 0, Card::AbusiveSergeant);
+			AddCard(g, 0, Card::AbusiveSergeant);
+			SetManaAndMax(g, 0, 2);
+			AddMinion(g, 0, Card::BloodfenRaptor);
+			g.UpdatePossibleMoves( );
+
+			CHECK_DO_MOVE(Move::PlayCard(Card::AbusiveSergeant, Move::TargetMinion(0, 0)));
+			CHECK_DO_MOVE(Move::PlayCard(Card::AbusiveSergeant, Move::TargetMinion(0, 0)));
+			CHECK(GetMinion(g, 0, 0).m_attack == GetCardData(Card::BloodfenRaptor)->m_attack + 4);
+			CHECK(GetMinion(g, 0, 0).AuraTotal(AuraDuration::EndOfTurn, MinionAuraEffect::BonusAttack) == 4);
+
+			CHECK_DO_MOVE(Move::EndTurn( ));
+			CHECK(GetMinion(g, 0, 0).m_attack == GetCardData(Card::BloodfenRaptor)->m_attack);
+			CHECK(GetMinion(g, 0, 0).AuraTotal(AuraDuration::EndOfTurn, MinionAuraEffect::BonusAttack) == 0);
+			CHECK(g.m_hash == g.ComputeHash( ));
+
+			return true;
+		}
+	},
 	{
 		"Minion affected by Abusive Sergeant normal damage on opponent's next turn", []( )
 		{
@@ -1158,6 +1312,720 @@ TestCase Tests[] =
 			CHECK_DO_MOVE(Move::PlayCard(Card::Alexstrasza, Move::TargetPlayer(0)));
 			CHECK(GetPlayerHealth(g, 0) == 15);
 
+			return true;
+		}
+	},
+	{
+		"Undo journal restores every move", []( )
+		{
+			Random r(1234);
+			UndoJournal journal;
+			for (int game = 0; game < 50; ++game)
+			{
+				GameState g = RandomGame(r);
+				while (g.m_winner == Winner::Undetermined)
+				{
+					Move m = g.m_possible_moves[RandomBelow(r, g.m_possible_moves.Num( ))];
+
+					GameState before(g);
+					UndoJournal::Mark mark = journal.GetMark( );
+					g.ProcessMove(m, &journal);
+					GameState after(g);
+
+					journal.RollBack(mark);
+					CHECK(SameState(g, before));
+					CHECK(journal.GetMark( ) == mark);
+
+					g.ProcessMove(m);
+					CHECK(SameState(g, after));
+				}
+			}
+
+			return true;
+		}
+	},
+	{
+		"Incremental hash matches hash from scratch", []( )
+		{
+			Random r(4321);
+			for (int game = 0; game < 50; ++game)
+			{
+				GameState g = RandomGame(r);
+				while (g.m_winner == Winner::Undetermined)
+				{
+					g.ProcessMove(g.m_possible_moves[RandomBelow(r, g.m_possible_moves.Num( ))]);
+					CHECK(g.m_hash == g.ComputeHash( ));
+				}
+			}
+
+			return true;
+		}
+	},
+	{
+		"Cached board masks match a rescan after every move", []( )
+		{
+			Random r(8765);
+			for (int game = 0; game < 50; ++game)
+			{
+				GameState g = RandomGame(r);
+				while (g.m_winner == Winner::Undetermined)
+				{
+					g.ProcessMove(g.m_possible_moves[RandomBelow(r, g.m_possible_moves.Num( ))]);
+					CHECK(g.m_players[0].m_minions.CachesMatch( ));
+					CHECK(g.m_players[1].m_minions.CachesMatch( ));
+				}
+			}
+
+			return true;
+		}
+	},
+	{
+		"Transposed attacks hash the same", []( )
+		{
+			GameState g;
+			AddMinionReadyToAttack(g, 0, Card::BluegillWarrior);
+			AddMinionReadyToAttack(g, 0, Card::Wisp);
+			g.UpdatePossibleMoves( );
+			GameState other(g);
+			uint64_t start_hash = g.m_hash;
+
+			CHECK_DO_MOVE(Move::AttackHero(0));
+			CHECK(g.m_hash != start_hash);
+			CHECK_DO_MOVE(Move::AttackHero(1));
+
+			std::swap(g, other);
+			CHECK_DO_MOVE(Move::AttackHero(1));
+			CHECK_DO_MOVE(Move::AttackHero(0));
+
+			CHECK(g.m_hash == other.m_hash);
+			CHECK(g.m_hash == g.ComputeHash( ));
+
+			return true;
+		}
+	},
+	{
+		"Transposition table replaces least visited node", []( )
+		{
+			struct Node
+			{
+				uint32_t m_visits;
+			};
+
+			// Budget for a single bucket, so every hash collides
+			TranspositionTable<Node> table(64);
+			Node nodes[5] = { { 5 }, { 1 }, { 7 }, { 3 }, { 2 } };
+			for (uint64_t i = 0; i < 4; ++i)
+			{
+				table.Insert(i, &nodes[i]);
+			}
+			for (uint64_t i = 0; i < 4; ++i)
+			{
+				CHECK(table.Find(i) == &nodes[i]);
+			}
+
+			table.Insert(4, &nodes[4]);
+			CHECK(table.Find(4) == &nodes[4]);
+			CHECK(table.Find(1) == nullptr);
+			CHECK(table.Find(0) == &nodes[0]);
+
+			table.Clear( );
+			CHECK(table.Find(0) == nullptr);
+
+			return true;
+		}
+	},
+	{
+		"Counted moves match the generated move list", []( )
+		{
+			Random r(31);
+			for (int round = 0; round < 20; ++round)
+			{
+				GameState g = RandomGame(r);
+				while (g.m_winner == Winner::Undetermined)
+				{
+					CHECK(g.CountPossibleMoves( ) == g.m_possible_moves.Num( ));
+					for (uint16_t i = 0; i < g.m_possible_moves.Num( ); ++i)
+					{
+						CHECK(g.GetPossibleMove(i) == g.m_possible_moves[i]);
+					}
+					g.ProcessMove(g.m_possible_moves[RandomBelow(r, g.m_possible_moves.Num( ))]);
+				}
+			}
+
+			return true;
+		}
+	},
+	{
+		"Move list kept up to date by ProcessMove matches a full rebuild", []( )
+		{
+			Random r(33);
+			for (int round = 0; round < 50; ++round)
+			{
+				GameState g = RandomGame(r);
+				while (g.m_winner == Winner::Undetermined)
+				{
+					g.ProcessMove(g.m_possible_moves[RandomBelow(r, g.m_possible_moves.Num( ))]);
+
+					GameState rebuilt(g);
+					rebuilt.UpdatePossibleMoves( );
+					CHECK(SameContents(g.m_possible_moves, rebuilt.m_possible_moves));
+				}
+			}
+
+			return true;
+		}
+	},
+	{
+		"Moves are totally ordered", []( )
+		{
+			const Move moves[] = {
+				Move::EndTurn( ),
+				Move::AttackMinion(0, 1),
+				Move::AttackMinion(1, 0),
+				Move::AttackHero(0),
+				Move::PlayCard(Card::HolySmite, Move::TargetMinion(0, 3)),
+				Move::PlayCard(Card::HolySmite, Move::TargetMinion(1, 0)),
+				Move::PlayCard(Card::HolySmite, Move::TargetPlayer(1)),
+				Move::PlayCard(Card::ElvenArcher, Move::TargetMinion(1, 0)),
+			};
+
+			for (const Move& a : moves)
+			{
+				CHECK(!(a < a));
+				for (const Move& b : moves)
+				{
+					CHECK((a == b) || ((a < b) != (b < a)));
+					for (const Move& c : moves)
+					{
+						CHECK(!(a < b && b < c) || a < c);
+					}
+				}
+			}
+
+			// Used to compare the minion even when the player decided it
+			CHECK(Move::TargetMinion(0, 3) < Move::TargetMinion(1, 0));
+			CHECK(!(Move::TargetMinion(1, 0) < Move::TargetMinion(0, 3)));
+
+			return true;
+		}
+	},
+	{
+		"Move ids round trip and the legal move set matches the move list", []( )
+		{
+			Random r(34);
+			for (int round = 0; round < 20; ++round)
+			{
+				GameState g = RandomGame(r);
+				while (g.m_winner == Winner::Undetermined)
+				{
+					MoveSet listed;
+					for (uint16_t i = 0; i < g.m_possible_moves.Num( ); ++i)
+					{
+						const Move m = g.m_possible_moves[i];
+						CHECK(GetMoveId(m) < NumMoveIds);
+						CHECK(GetMove(GetMoveId(m)) == m);
+						CHECK(g.m_legal_moves.Contains(m));
+						listed.Add(GetMoveId(m));
+					}
+					CHECK(g.m_legal_moves.Num( ) == listed.Num( ));
+
+					const unsigned n = RandomBelow(r, listed.Num( ));
+					CHECK(g.m_possible_moves.Contains(GetMove(listed.Nth(n))));
+
+					g.ProcessMove(g.m_possible_moves[RandomBelow(r, g.m_possible_moves.Num( ))]);
+				}
+			}
+
+			return true;
+		}
+	},
+	{
+		"Journaled playout rolls back", []( )
+		{
+			Random r(32);
+			UndoJournal journal;
+			for (int round = 0; round < 10; ++round)
+			{
+				GameState g = RandomGame(r);
+				const GameState before(g);
+				UndoJournal::Mark mark = journal.GetMark( );
+				g.PlayOutRandomly(r, &journal);
+				CHECK(g.m_winner != Winner::Undetermined);
+				journal.RollBack(mark);
+				CHECK(SameState(g, before));
+			}
+
+			return true;
+		}
+	},
+	{
+		"UCT scores pick the same child as the direct formula, up to rounding", []( )
+		{
+			Random r(36);
+			uint32_t wins[300];
+			uint32_t visits[300];
+			uint32_t availability[300];
+			float scores[300];
+			for (int round = 0; round < 200; ++round)
+			{
+				// Mostly small counts, with some past the end of the tables
+				const unsigned num = 1 + RandomBelow(r, 300);
+				const uint32_t max_visits = round % 4 == 0 ? 100000 : 50;
+				uint32_t parent_visits = 0;
+				for (unsigned i = 0; i < num; ++i)
+				{
+					visits[i] = 1 + RandomBelow(r, max_visits);
+					wins[i] = RandomBelow(r, visits[i] + 1);
+					availability[i] = visits[i] + RandomBelow(r, max_visits);
+					parent_visits += visits[i];
+				}
+
+				for (int with_availability = 0; with_availability < 2; ++with_availability)
+				{
+					double direct[300];
+					double best_direct = 0.0;
+					for (unsigned i = 0; i < num; ++i)
+					{
+						const double n = with_availability ? availability[i] : parent_visits;
+						direct[i] = wins[i] / (double)visits[i] + sqrt(log(n) / visits[i]);
+						best_direct = std::max(best_direct, direct[i]);
+					}
+
+					if (with_availability)
+					{
+						UCTScores(wins, visits, availability, num, scores);
+					}
+					else
+					{
+						UCTScores(wins, visits, num, parent_visits, scores);
+					}
+
+					for (unsigned i = 0; i < num; ++i)
+					{
+						CHECK(fabs(scores[i] - direct[i]) <= direct[i] * 1e-6);
+					}
+
+					const unsigned best = BestScore(scores, num);
+					CHECK(direct[best] >= best_direct * (1.0 - 1e-6));
+					for (unsigned i = 0; i < num; ++i)
+					{
+						CHECK(i < best ? scores[i] < scores[best] : scores[i] <= scores[best]);
+					}
+				}
+			}
+
+			return true;
+		}
+	},
+	{
+		"Searches only choose legal moves and keep their trees across a game", []( )
+		{
+			Random r(35);
+			for (int round = 0; round < 2; ++round)
+			{
+				GameState g = RandomGame(r);
+				CheatingMCTS::Search cheating(200);
+				DeterminizedMCTS::Search determinized(4, 50);
+				SO_IS_MCTS::Search so_is(200);
+				while (g.m_winner == Winner::Undetermined)
+				{
+					CHECK(g.m_legal_moves.Contains(cheating.ChooseMove(g)));
+					CHECK(g.m_legal_moves.Contains(determinized.ChooseMove(g)));
+					CHECK(g.m_legal_moves.Contains(SO_IS_MCTS::ChooseMove(g, 100, r( ))));
+					CHECK(g.m_legal_moves.Contains(DeterminizedMCTS::ChooseMove(g, 2, 50, r( ))));
+					CHECK(g.m_legal_moves.Contains(SO_IS_MCTS::ChooseMove(g, 100, 2, r( ))));
+					CHECK(g.m_legal_moves.Contains(DeterminizedMCTS::ChooseMove(g, 2, 50, 2, r( ))));
+
+					const Move m = so_is.ChooseMove(g);
+					CHECK(g.m_legal_moves.Contains(m));
+					cheating.MovePlayed(m);
+					determinized.MovePlayed(m);
+					so_is.MovePlayed(m);
+					g.ProcessMove(m);
+				}
+			}
+
+			return true;
+		}
+	},
+	{
+		"Searches run every iteration they're given, or stop close to their time", []( )
+		{
+			Random r(36);
+			GameState g = RandomGame(r);
+			for (int i = 0; i < 6 && g.m_winner == Winner::Undetermined; ++i)
+			{
+				g.ProcessMove(g.m_possible_moves[0]);
+			}
+			if (g.m_winner != Winner::Undetermined)
+				return false;
+
+			unsigned iterations = 0;
+			CHECK(g.m_legal_moves.Contains(CheatingMCTS::ChooseMove(g, 50, 1, &iterations)));
+			CHECK(iterations == 50);
+			CHECK(g.m_legal_moves.Contains(DeterminizedMCTS::ChooseMove(g, 3, 50, 2, &iterations)));
+			CHECK(iterations == 150);
+			CHECK(g.m_legal_moves.Contains(SO_IS_MCTS::ChooseMove(g, 50, 2, 3, &iterations)));
+			CHECK(iterations == 50);
+
+			// Generous, as the clock is only read every few iterations and the machine may be busy
+			const HighResClock::duration budget = std::chrono::milliseconds(20);
+			const HighResClock::duration slack = std::chrono::milliseconds(250);
+			const SearchBudget timed = SearchBudget::Time(budget);
+			CheatingMCTS::Search cheating(timed);
+			DeterminizedMCTS::Search determinized(4, timed);
+			SO_IS_MCTS::Search so_is(timed);
+			for (int search = 0; search < 7; ++search)
+			{
+				iterations = 0;
+				const HighResClock::time_point start = HighResClock::now( );
+				Move m;
+				switch (search)
+				{
+				case 0: m = CheatingMCTS::ChooseMove(g, timed, 1, &iterations); break;
+				case 1: m = DeterminizedMCTS::ChooseMove(g, 4, timed, 2, &iterations); break;
+				case 2: m = DeterminizedMCTS::ChooseMove(g, 4, timed, 2, 3, &iterations); break;
+				case 3: m = SO_IS_MCTS::ChooseMove(g, timed, 2, 4, &iterations); break;
+				case 4: m = cheating.ChooseMove(g, &iterations); break;
+				case 5: m = determinized.ChooseMove(g, &iterations); break;
+				default: m = so_is.ChooseMove(g, &iterations); break;
+				}
+				const HighResClock::duration elapsed = HighResClock::now( ) - start;
+
+				CHECK(g.m_legal_moves.Contains(m));
+				CHECK(iterations >= 1);
+				CHECK(elapsed >= budget);
+				CHECK(elapsed < budget + slack);
+			}
+
+			return true;
+		}
+	},
+	{
+		"Free searches given the same seed and iterations choose the same move", []( )
+		{
+			Random r(37);
+			for (int game = 0; game < 4; ++game)
+			{
+				GameState g = RandomGame(r);
+				for (int i = 0; i < 4 && g.m_winner == Winner::Undetermined; ++i)
+				{
+					g.ProcessMove(g.m_possible_moves[0]);
+				}
+				if (g.m_winner != Winner::Undetermined)
+					continue;
+
+				const uint64_t seed = r( );
+				CHECK(CheatingMCTS::ChooseMove(g, 100, seed) == CheatingMCTS::ChooseMove(g, 100, seed));
+				CHECK(DeterminizedMCTS::ChooseMove(g, 3, 50, seed) == DeterminizedMCTS::ChooseMove(g, 3, 50, seed));
+				CHECK(SO_IS_MCTS::ChooseMove(g, 100, seed) == SO_IS_MCTS::ChooseMove(g, 100, seed));
+
+				// Root parallel visits are summed per determinization, so the thread count doesn't matter
+				CHECK(DeterminizedMCTS::ChooseMove(g, 5, 50, 1, seed) == DeterminizedMCTS::ChooseMove(g, 5, 50, 3, seed));
+			}
+
+			return true;
+		}
+	},
+	{
+		"Multithreaded tournaments play exactly the games asked for", []( )
+		{
+			// A number of rounds that doesn't split evenly between threads, with quick searches
+			const uint32_t rounds = 3;
+			TournamentOptions options;
+			options.m_move_time = std::chrono::milliseconds(1);
+			PlayResults results;
+			AITournamentMT(rounds, results, options);
+
+			for (const PairingResults& res : results.m_results)
+			{
+				CHECK(res.m_player_one_wins + res.m_player_two_wins + res.m_draws == rounds);
+			}
+
+			return true;
+		}
+	},
+	{
+		"Game logs read back every record written to them, from any number of writers", []( )
+		{
+			const char* path = "GameLogTest.hpgl";
+			const char* csv_path = "GameLogTest.csv";
+			const uint32_t num_records = 3000;
+
+			// Each record's fields all follow from its seed
+			auto make_record = [](uint32_t i, GameRecord& record)
+			{
+				record.m_seed = 0x100000000ull * i + 7;
+				record.m_deck_id = i / 10;
+				record.m_turns = (uint16_t)(i % 40);
+				record.m_player_one = (AIType)(i % (uint32_t)AIType::MAX);
+				record.m_player_two = (AIType)((i / 4) % (uint32_t)AIType::MAX);
+				record.m_winner = (Winner)(i % 3);
+				record.m_think_us.resize(i % 70);
+				for (size_t m = 0; m < record.m_think_us.size( ); ++m)
+				{
+					record.m_think_us[m] = (uint32_t)(i * 1000 + m);
+				}
+			};
+
+			{
+				GameLog log;
+				CHECK(log.Open(path));
+				GameLogWriter writer_one(log);
+				GameLogWriter writer_two(log);
+				GameRecord record;
+				for (uint32_t i = 0; i < num_records; ++i)
+				{
+					make_record(i, record);
+					(i % 2 ? writer_two : writer_one).Append(record);
+				}
+			}
+
+			GameLogReader reader;
+			CHECK(reader.Open(path));
+			std::vector<bool> seen(num_records, false);
+			GameRecord record, expected;
+			uint32_t num_read = 0;
+			while (reader.Next(record))
+			{
+				const uint32_t i = (uint32_t)(record.m_seed >> 32);
+				CHECK(i < num_records && !seen[i]);
+				seen[i] = true;
+				make_record(i, expected);
+				CHECK(record.m_seed == expected.m_seed);
+				CHECK(record.m_deck_id == expected.m_deck_id);
+				CHECK(record.m_turns == expected.m_turns);
+				CHECK(record.m_player_one == expected.m_player_one);
+				CHECK(record.m_player_two == expected.m_player_two);
+				CHECK(record.m_winner == expected.m_winner);
+				CHECK(record.m_think_us == expected.m_think_us);
+				++num_read;
+			}
+			CHECK(num_read == num_records);
+
+			CHECK(ConvertGameLogToCSV(path, csv_path));
+			std::ifstream csv(csv_path);
+			uint32_t num_lines = 0;
+			for (std::string line; std::getline(csv, line); )
+			{
+				++num_lines;
+			}
+			csv.close( );
+			CHECK(num_lines == num_records + 1);
+
+			remove(path);
+			remove(csv_path);
+			return true;
+		}
+	},
+	{
+		"Philox matches the reference known answers", []( )
+		{
+			// From the Random123 known answer tests
+			const uint32_t counters[3][4] = {
+				{ 0, 0, 0, 0 },
+				{ 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF },
+				{ 0x243F6A88, 0x85A308D3, 0x13198A2E, 0x03707344 } };
+			const uint32_t keys[3][2] = {
+				{ 0, 0 },
+				{ 0xFFFFFFFF, 0xFFFFFFFF },
+				{ 0xA4093822, 0x299F31D0 } };
+			const uint32_t expected[3][4] = {
+				{ 0x6627E8D5, 0xE169C58D, 0xBC57AC4C, 0x9B00DBD8 },
+				{ 0x408F276D, 0x41C83B0E, 0xA20BC7C6, 0x6D5451FD },
+				{ 0xD16CFE09, 0x94FDCCEB, 0x5001E420, 0x24126EA1 } };
+
+			for (int i = 0; i < 3; ++i)
+			{
+				uint32_t out[4];
+				Philox4x32(counters[i], keys[i], out);
+				CHECK(memcmp(out, expected[i], sizeof(out)) == 0);
+			}
+
+			CHECK(StreamSeed(1, 0, 0) != StreamSeed(2, 0, 0));
+			CHECK(StreamSeed(1, 0, 0) != StreamSeed(1, 1, 0));
+			CHECK(StreamSeed(1, 0, 0) != StreamSeed(1, 0, 1));
+			CHECK(StreamSeed(1, 0, 0) != StreamSeed(1, 0, 0, 1));
+			return true;
+		}
+	},
+	{
+		"Seeded tournaments play the same games however many threads they have", []( )
+		{
+			const char* paths[2] = { "TournamentTest1.hpgl", "TournamentTest2.hpgl" };
+			const uint32_t rounds = 2;
+
+			// Think times differ from run to run, but nothing else may
+			typedef std::tuple<uint64_t, uint32_t, AIType, AIType, Winner, uint16_t, size_t> GameSummary;
+			std::vector<GameSummary> games[2];
+			PlayResults results[2];
+			for (int run = 0; run < 2; ++run)
+			{
+				GameLog log;
+				CHECK(log.Open(paths[run]));
+
+				TournamentOptions options;
+				options.m_seed = 12345;
+				options.m_iterations = 40;
+				options.m_max_threads = run == 0 ? 1 : 3;
+				options.m_log = &log;
+				AITournamentMT(rounds, results[run], options);
+				log.Close( );
+
+				GameLogReader reader;
+				CHECK(reader.Open(paths[run]));
+				GameRecord record;
+				while (reader.Next(record))
+				{
+					games[run].emplace_back(record.m_seed, record.m_deck_id, record.m_player_one, record.m_player_two, record.m_winner, record.m_turns, record.m_think_us.size( ));
+				}
+				std::sort(games[run].begin( ), games[run].end( ));
+			}
+
+			remove(paths[0]);
+			remove(paths[1]);
+			CHECK(games[0].size( ) == rounds * (uint32_t)AIType::MAX * (uint32_t)AIType::MAX);
+			CHECK(games[0] == games[1]);
+			CHECK(memcmp(&results[0], &results[1], sizeof(PlayResults)) == 0);
+			return true;
+		}
+	},
+	{
+		"SPRT stops one sided matches quickly and even ones on H0", []( )
+		{
+			const SPRT test(0.0, 50.0, 0.05, 0.05);
+			CHECK(test.Test(0, 0, 0) == SPRT::Result::Continue);
+
+			uint32_t games = 0;
+			while (test.Test(games, 0, 0) == SPRT::Result::Continue)
+			{
+				++games;
+			}
+			CHECK(test.Test(games, 0, 0) == SPRT::Result::AcceptH1);
+			CHECK(games <= 20);
+
+			games = 0;
+			while (test.Test(0, 0, games) == SPRT::Result::Continue)
+			{
+				++games;
+			}
+			CHECK(test.Test(0, 0, games) == SPRT::Result::AcceptH0);
+			CHECK(games <= 10);
+
+			// Alternate wins and losses, with a draw every so often
+			uint32_t wins = 0, draws = 0, losses = 0;
+			for (games = 0; test.Test(wins, draws, losses) == SPRT::Result::Continue; ++games)
+			{
+				(games % 5 == 4 ? draws : games % 2 ? losses : wins)++;
+			}
+			CHECK(test.Test(wins, draws, losses) == SPRT::Result::AcceptH0);
+			CHECK(games > 50 && games < 2000);
+			return true;
+		}
+	},
+	{
+		"SPRT tournaments stop each pairing at the same game however many threads they have", []( )
+		{
+			const uint32_t max_games = 12;
+			const SPRT test(0.0, 150.0, 0.1, 0.1);
+			PlayResults results[2];
+			SPRTResults tests[2];
+			for (int run = 0; run < 2; ++run)
+			{
+				TournamentOptions options;
+				options.m_seed = 321;
+				options.m_iterations = 30;
+				options.m_max_threads = run == 0 ? 1 : 3;
+				AITournamentSPRT(max_games, test, results[run], tests[run], options);
+			}
+
+			bool any_stopped_early = false;
+			for (uint32_t i = 0; i < (uint32_t)AIType::MAX * (uint32_t)AIType::MAX; ++i)
+			{
+				const PairingTest& a = tests[0].m_tests[i];
+				const PairingTest& b = tests[1].m_tests[i];
+				const uint32_t games = a.m_player_one_wins + a.m_player_two_wins + a.m_draws;
+				CHECK(games >= 1 && games <= max_games);
+				CHECK(a.m_result == b.m_result && a.m_player_one_wins == b.m_player_one_wins && a.m_player_two_wins == b.m_player_two_wins && a.m_draws == b.m_draws);
+				CHECK(results[0].m_results[i].m_player_one_wins == a.m_player_one_wins);
+				CHECK(a.m_result != SPRT::Result::Continue || games == max_games);
+				any_stopped_early |= games < max_games;
+			}
+			CHECK(any_stopped_early);
+			return true;
+		}
+	},
+	{
+		"Ratings recover the strengths that generated the results", []( )
+		{
+			const double true_elo[4] = { -300.0, -50.0, 100.0, 250.0 };
+			Ratings ratings(4);
+			Random r(37);
+			for (int game = 0; game < 4000; ++game)
+			{
+				const unsigned a = RandomBelow(r, 4);
+				const unsigned b = (a + 1 + RandomBelow(r, 3)) % 4;
+				const double p = 1.0 / (1.0 + pow(10.0, (true_elo[b] - true_elo[a]) / 400.0));
+				ratings.AddResult(a, b, RandomBelow(r, 1000000) < p * 1000000 ? Winner::PlayerOne : Winner::PlayerTwo);
+			}
+			ratings.Fit( );
+
+			double error_before = 0.0;
+			for (unsigned i = 0; i < 4; ++i)
+			{
+				CHECK(fabs(ratings.Elo(i) - true_elo[i]) < 3.0 * ratings.EloError(i));
+				CHECK(ratings.EloError(i) > 5.0 && ratings.EloError(i) < 40.0);
+				error_before += ratings.EloError(i);
+			}
+
+			// A planned game shrinks the variance by as much as predicted
+			const double variance = ratings.TotalVariance( );
+			const double reduction = ratings.VarianceReduction(0, 3);
+			ratings.AddPlannedGame(0, 3);
+			CHECK(reduction > 0.0);
+			CHECK(fabs(variance - ratings.TotalVariance( ) - reduction) < reduction * 1e-6);
+
+			// One player winning everything still gets a finite rating, well above the rest
+			Ratings one_sided(3);
+			for (int game = 0; game < 20; ++game)
+			{
+				one_sided.AddResult(0, 1 + game % 2, Winner::PlayerOne);
+				one_sided.AddResult(1, 2, game % 2 ? Winner::PlayerOne : Winner::Draw);
+			}
+			one_sided.Fit( );
+			CHECK(one_sided.Elo(0) > one_sided.Elo(1) + 100.0 && one_sided.Elo(1) > one_sided.Elo(2));
+			CHECK(one_sided.Elo(0) < 3000.0);
+			return true;
+		}
+	},
+	{
+		"Rated tournaments choose the same games however many threads they have", []( )
+		{
+			const uint32_t num_games = 40;
+			PlayResults results[2];
+			Ratings ratings[2] = { Ratings((unsigned)AIType::MAX), Ratings((unsigned)AIType::MAX) };
+			for (int run = 0; run < 2; ++run)
+			{
+				TournamentOptions options;
+				options.m_seed = 99;
+				options.m_iterations = 20;
+				options.m_max_threads = run == 0 ? 1 : 3;
+				AITournamentRated(num_games, results[run], ratings[run], options);
+			}
+
+			uint32_t total = 0;
+			for (AIType ai = AIType::Random; ai != AIType::MAX; ai = (AIType)(1 + (int)ai))
+			{
+				const PairingResults& mirror = results[0].m_results[(uint32_t)ai * (uint32_t)AIType::MAX + (uint32_t)ai];
+				CHECK(mirror.m_player_one_wins + mirror.m_player_two_wins + mirror.m_draws == 0);
+				CHECK(ratings[0].Elo((unsigned)ai) == ratings[1].Elo((unsigned)ai));
+			}
+			for (const PairingResults& res : results[0].m_results)
+			{
+				total += res.m_player_one_wins + res.m_player_two_wins + res.m_draws;
+			}
+			CHECK(total == num_games);
+			CHECK(memcmp(&results[0], &results[1], sizeof(PlayResults)) == 0);
 			return true;
 		}
 	}
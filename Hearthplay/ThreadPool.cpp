@@ -0,0 +1,101 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+const unsigned ThreadPool::MaxThreads;
+
+ThreadPool::ThreadPool(unsigned num_threads)
+	: m_func(nullptr)
+	, m_num_jobs(0)
+	, m_next_job(0)
+	, m_num_participants(0)
+	, m_num_busy(0)
+	, m_generation(0)
+	, m_quit(false)
+{
+	num_threads = std::min(std::max(num_threads, 1u), MaxThreads);
+	for (unsigned i = 1; i < num_threads; ++i)
+	{
+		m_workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool( )
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_start_cv.notify_all( );
+
+	for (std::thread& t : m_workers)
+	{
+		t.join( );
+	}
+}
+
+void ThreadPool::ParallelFor(unsigned num_jobs, unsigned max_threads, const JobFunction& func)
+{
+	std::lock_guard<std::mutex> batch_lock(m_batch_mutex);
+
+	unsigned num_participants = std::min(std::min(std::max(max_threads, 1u), NumThreads( )), std::max(num_jobs, 1u));
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_func = &func;
+		m_num_jobs = num_jobs;
+		m_next_job = 0;
+		m_num_participants = num_participants;
+		m_num_busy = num_participants - 1;
+		++m_generation;
+	}
+	if (num_participants > 1)
+	{
+		m_start_cv.notify_all( );
+	}
+
+	RunJobs(0);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done_cv.wait(lock, [this]( ) { return m_num_busy == 0; });
+	m_func = nullptr;
+}
+
+void ThreadPool::RunJobs(unsigned thread_index)
+{
+	for (unsigned job = m_next_job++; job < m_num_jobs; job = m_next_job++)
+	{
+		(*m_func)(job, thread_index);
+	}
+}
+
+void ThreadPool::WorkerLoop(unsigned thread_index)
+{
+	uint64_t seen_generation = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_start_cv.wait(lock, [&]( ) { return m_quit || m_generation != seen_generation; });
+			if (m_quit)
+				return;
+
+			seen_generation = m_generation;
+			if (thread_index >= m_num_participants)
+				continue;
+		}
+
+		RunJobs(thread_index);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			--m_num_busy;
+		}
+		m_done_cv.notify_one( );
+	}
+}
+
+ThreadPool& ThreadPool::Shared( )
+{
+	static ThreadPool pool(std::thread::hardware_concurrency( ));
+	return pool;
+}
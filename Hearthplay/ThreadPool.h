@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run one batch of jobs at a time.
+// The thread calling ParallelFor works on the batch too, as thread index 0.
+class ThreadPool
+{
+public:
+	typedef std::function<void(unsigned job_index, unsigned thread_index)> JobFunction;
+
+	static const unsigned MaxThreads = 64;
+
+	ThreadPool(unsigned num_threads);
+	~ThreadPool( );
+
+	ThreadPool(const ThreadPool& other) = delete;
+	ThreadPool& operator=(const ThreadPool& other) = delete;
+
+	inline unsigned NumThreads( ) const
+	{
+		return (unsigned)m_workers.size( ) + 1;
+	}
+
+	// Call func for every job index in [0, num_jobs) using at most max_threads threads, and wait for all of them.
+	// Jobs are handed out dynamically, so uneven jobs still keep every thread busy.
+	// Batches from different callers are run one after another, so a job must never call ParallelFor on the
+	// same pool: the nested call waits on m_batch_mutex, which the outer batch holds, and deadlocks.
+	void ParallelFor(unsigned num_jobs, unsigned max_threads, const JobFunction& func);
+
+	// Pool with one thread per hardware thread, created on first use
+	static ThreadPool& Shared( );
+
+private:
+	void WorkerLoop(unsigned thread_index);
+	void RunJobs(unsigned thread_index);
+
+	std::vector<std::thread>	m_workers;
+
+	std::mutex					m_batch_mutex;
+	std::mutex					m_mutex;
+	std::condition_variable		m_start_cv;
+	std::condition_variable		m_done_cv;
+
+	const JobFunction*			m_func;
+	unsigned					m_num_jobs;
+	std::atomic<unsigned>		m_next_job;
+	unsigned					m_num_participants;
+	unsigned					m_num_busy;
+	uint64_t					m_generation;
+	bool						m_quit;
+};
@@ -2,9 +2,13 @@
 #include "GameState.h"
 #include "MCTS.h"
 #include "Clock.h"
+#include "ThreadPool.h"
+#include "GameLog.h"
+#include "Ratings.h"
 
-#include <thread>
-#include <future>
+#include <algorithm>
+#include <memory>
+#include <mutex>
 
 #if 0
 #define DEBUG_GAME(...) __VA_ARGS__
@@ -20,7 +24,7 @@ const char* AINames[] = {
 };
 
 
-static GameState SetupGame(const Card(&deck)[30], std::mt19937& r)
+static GameState SetupGame(const Card(&deck)[30], Random& r)
 {
 	GameState game;
 	game.m_players[0].m_deck.Set(deck, sizeof(deck) / sizeof(Card));
@@ -45,20 +49,121 @@ static GameState SetupGame(const Card(&deck)[30], std::mt19937& r)
 	return game;
 }
 
-Move PlayRandomMove(const GameState& state)
+Move PlayRandomMove(const GameState& state, Random& r)
 {
-	uint16_t idx = rand( ) % state.m_possible_moves.Num( );
+	uint16_t idx = (uint16_t)RandomBelow(r, state.m_possible_moves.Num( ));
 	return state.m_possible_moves[idx];
 }
 
-static PlayFunction PlayFunctions[] =
+// The kinds of random stream a tournament draws from, each named by the master seed and an index
+enum class TournamentStream : uint32_t
 {
-	PlayRandomMove,
-	[](const GameState& state) { return CheatingMCTS::ChooseMove(state, 1000); },
-	[](const GameState& state) { return DeterminizedMCTS::ChooseMove(state, 10, 100); },
-	[](const GameState& state) { return SO_IS_MCTS::ChooseMove(state, 1000); },
+	Deck,
+	Game,
+	Search
 };
 
+// One of each AI for a seat at the table. Kept between moves so searches can reuse their trees,
+// and between games so they can reuse their memory.
+struct Seat
+{
+	static const unsigned Determinizations = 10;
+
+	CheatingMCTS::Search		m_cheating;
+	DeterminizedMCTS::Search	m_determinized;
+	SO_IS_MCTS::Search			m_so_is;
+
+	Seat(const TournamentOptions& options)
+		: m_cheating(Budget(options, options.m_iterations))
+		, m_determinized(Determinizations, Budget(options, std::max(options.m_iterations / Determinizations, 1u)))
+		, m_so_is(Budget(options, options.m_iterations))
+	{
+	}
+
+	static SearchBudget Budget(const TournamentOptions& options, unsigned iterations)
+	{
+		return options.m_move_time.count( ) > 0 ? SearchBudget::Time(options.m_move_time) : SearchBudget(iterations);
+	}
+
+	// Every search gets a stream of its own for the game, named by the game and the seat, so nothing
+	// it draws depends on the games played before it or on which thread plays it
+	void NewGame(uint64_t seed, uint32_t game, uint32_t seat)
+	{
+		m_cheating.Reset( );
+		m_determinized.Reset( );
+		m_so_is.Reset( );
+
+		const uint32_t first = seat * (uint32_t)AIType::MAX;
+		m_cheating.Seed(StreamSeed(seed, (uint32_t)TournamentStream::Search, game, first + (uint32_t)AIType::CheatingMCTS));
+		m_determinized.Seed(StreamSeed(seed, (uint32_t)TournamentStream::Search, game, first + (uint32_t)AIType::DeterminizedMCTS));
+		m_so_is.Seed(StreamSeed(seed, (uint32_t)TournamentStream::Search, game, first + (uint32_t)AIType::SO_IS_MCTS));
+	}
+
+	Move ChooseMove(AIType ai, const GameState& game, Random& r)
+	{
+		switch (ai)
+		{
+		case AIType::CheatingMCTS: return m_cheating.ChooseMove(game);
+		case AIType::DeterminizedMCTS: return m_determinized.ChooseMove(game);
+		case AIType::SO_IS_MCTS: return m_so_is.ChooseMove(game);
+		default: return PlayRandomMove(game, r);
+		}
+	}
+
+	void MovePlayed(AIType ai, const Move& m)
+	{
+		switch (ai)
+		{
+		case AIType::CheatingMCTS: m_cheating.MovePlayed(m); break;
+		case AIType::DeterminizedMCTS: m_determinized.MovePlayed(m); break;
+		case AIType::SO_IS_MCTS: m_so_is.MovePlayed(m); break;
+		default: break; // The random AI keeps no state
+		}
+	}
+};
+
+PairingTest::PairingTest( )
+	: m_player_one_wins(0)
+	, m_player_two_wins(0)
+	, m_draws(0)
+	, m_llr(0.0)
+	, m_result(SPRT::Result::Continue)
+{
+}
+
+void SPRTResults::Print(const SPRT& test) const
+{
+	printf("SPRT of player one's Elo advantage, H0 %.1f, H1 %.1f, alpha %.3f, beta %.3f, bounds %.2f, %.2f\n\n",
+		   test.m_elo0, test.m_elo1, test.m_alpha, test.m_beta, test.LowerBound( ), test.UpperBound( ));
+	printf("| Matchup | Games | Player One Wins | Player Two Wins | Draws | LLR | Result |\n");
+	printf("| ------------- | ------------- | ------------- | ------------- | ------------- | ------------- | ------------- |\n");
+
+	static const char* ResultNames[] = { "Undecided", "H0", "H1" };
+	for (AIType player_one = AIType::Random; player_one != AIType::MAX; player_one = (AIType)(1 + (int)player_one))
+	{
+		for (AIType player_two = AIType::Random; player_two != AIType::MAX; player_two = (AIType)(1 + (int)player_two))
+		{
+			const PairingTest& res = m_tests[(uint32_t)player_two * (uint32_t)AIType::MAX + (uint32_t)player_one];
+			printf("| %s vs %s | %u | %u | %u | %u | %.2f | %s |\n",
+				   AINames[(int)player_one],
+				   AINames[(int)player_two],
+				   res.m_player_one_wins + res.m_player_two_wins + res.m_draws,
+				   res.m_player_one_wins, res.m_player_two_wins, res.m_draws,
+				   res.m_llr, ResultNames[(int)res.m_result]
+				   );
+		}
+	}
+}
+
+TournamentOptions::TournamentOptions( )
+	: m_move_time(0)
+	, m_iterations(1000)
+	, m_seed(((uint64_t)GlobalRandomDevice( ) << 32) | GlobalRandomDevice( ))
+	, m_max_threads(ThreadPool::MaxThreads)
+	, m_log(nullptr)
+{
+}
+
 PlayResults::PlayResults( )
 {
 	memset(&m_results, 0, sizeof(m_results));
@@ -113,9 +218,28 @@ void PlayResults::Print( ) const
 	}
 }
 
-static Winner PlayGame(std::mt19937& r, const Card(&deck)[30], AIType player_one, AIType player_two)
+static const uint32_t RoundsPerDeck = 10;
+
+static void DealDeck(Random& r, Card(&deck)[30])
+{
+	for (Card& c : deck)
+	{
+		c = DeckPossibleCards[RandomBelow(r, (uint32_t)DeckPossibleCards.size( ))];
+	}
+}
+
+// Fills in everything in record but the seed and deck id
+static void PlayGame(Random& r, const Card(&deck)[30], AIType player_one, AIType player_two, Seat& seat_one, Seat& seat_two, GameRecord& record)
 {
 	GameState game = SetupGame(deck, r);
+	const AIType ais[2] = { player_one, player_two };
+	Seat* seats[2] = { &seat_one, &seat_two };
+
+	record.m_player_one = player_one;
+	record.m_player_two = player_two;
+	record.m_turns = 1;
+	record.m_think_us.clear( );
+
 	while (game.m_winner == Winner::Undetermined)
 	{
 		DEBUG_GAME(
@@ -124,70 +248,270 @@ static Winner PlayGame(std::mt19937& r, const Card(&deck)[30], AIType player_one
 		printf("\n");
 		);
 
-		Move m = Move::EndTurn( );
-		if (game.m_active_player_index == 0)
+		const HighResClock::time_point think_start = HighResClock::now( );
+		Move m = seats[game.m_active_player_index]->ChooseMove(ais[game.m_active_player_index], game, r);
+		record.m_think_us.push_back((uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(HighResClock::now( ) - think_start).count( ));
+		DEBUG_GAME(game.PrintMove(m));
+		game.ProcessMove(m);
+
+		if (m.m_type == MoveType::EndTurn && game.m_winner == Winner::Undetermined)
 		{
-			m = PlayFunctions[(int)player_one](game);
+			++record.m_turns;
 		}
-		else
+
+		seats[0]->MovePlayed(player_one, m);
+		seats[1]->MovePlayed(player_two, m);
+	}
+	record.m_winner = game.m_winner;
+}
+
+// What each thread of a tournament keeps between its games
+struct TournamentThread
+{
+	std::unique_ptr<Seat> m_seats[2];
+	std::unique_ptr<GameLogWriter> m_log_writer;
+	GameRecord m_record;
+	PlayResults m_results;
+};
+
+static const uint32_t GamesPerRound = (uint32_t)AIType::MAX * (uint32_t)AIType::MAX;
+
+// Rated tournaments choose this many games at a time, and refit the ratings after each batch
+static const uint32_t RatedBatchGames = 16;
+
+// Decks for the rounds are dealt up front, so every game is a job of its own which any thread can pick up
+static std::unique_ptr<Card[][30]> DealDecks(const TournamentOptions& options, uint32_t num_rounds)
+{
+	const uint32_t num_decks = (num_rounds + RoundsPerDeck - 1) / RoundsPerDeck;
+	std::unique_ptr<Card[][30]> decks(new Card[num_decks][30]);
+	for (uint32_t i = 0; i < num_decks; ++i)
+	{
+		Random deck_r(StreamSeed(options.m_seed, (uint32_t)TournamentStream::Deck, i));
+		DealDeck(deck_r, decks[i]);
+	}
+	return decks;
+}
+
+// Plays game number game of the tournament, which is the game between the pairing game % GamesPerRound
+// in round game / GamesPerRound. Everything random in it follows from the seed and that number.
+static Winner PlayTournamentGame(const TournamentOptions& options, const Card(*decks)[30], uint32_t game, TournamentThread& thread)
+{
+	// Seats are only made once a thread plays a game, and each thread logs through its own writer
+	if (!thread.m_seats[0])
+	{
+		thread.m_seats[0].reset(new Seat(options));
+		thread.m_seats[1].reset(new Seat(options));
+		if (options.m_log)
 		{
-			m = PlayFunctions[(int)player_two](game);
+			thread.m_log_writer.reset(new GameLogWriter(*options.m_log));
 		}
-		DEBUG_GAME(game.PrintMove(m));
-		game.ProcessMove(m);
 	}
-	return game.m_winner;
+
+	const uint32_t round = game / GamesPerRound;
+	const AIType player_one = (AIType)((game % GamesPerRound) / (uint32_t)AIType::MAX);
+	const AIType player_two = (AIType)(game % (uint32_t)AIType::MAX);
+
+	GameRecord& record = thread.m_record;
+	record.m_seed = StreamSeed(options.m_seed, (uint32_t)TournamentStream::Game, game);
+	record.m_deck_id = round / RoundsPerDeck;
+	Random game_r(record.m_seed);
+	thread.m_seats[0]->NewGame(options.m_seed, game, 0);
+	thread.m_seats[1]->NewGame(options.m_seed, game, 1);
+	PlayGame(game_r, decks[record.m_deck_id], player_one, player_two, *thread.m_seats[0], *thread.m_seats[1], record);
+
+	if (thread.m_log_writer)
+	{
+		thread.m_log_writer->Append(record);
+	}
+	return record.m_winner;
+}
+
+void AITournament( uint32_t num_rounds, PlayResults& results, const TournamentOptions& options )
+{
+	// The same games as the multithreaded version, one after another on this thread
+	TournamentOptions one_thread(options);
+	one_thread.m_max_threads = 1;
+	AITournamentMT(num_rounds, results, one_thread);
+}
+
+void AITournamentMT( uint32_t total_rounds, PlayResults& out_results, const TournamentOptions& options )
+{
+	// Threads take the next game as soon as they finish one, so they all stay busy until the last few games.
+	// The searches don't use the pool themselves, which would wait on this batch.
+	const std::unique_ptr<Card[][30]> decks = DealDecks(options, total_rounds);
+	ThreadPool& pool = ThreadPool::Shared( );
+	std::unique_ptr<TournamentThread[]> threads(new TournamentThread[pool.NumThreads( )]);
+
+	pool.ParallelFor(total_rounds * GamesPerRound, options.m_max_threads, [&](unsigned game, unsigned thread_index)
+	{
+		TournamentThread& thread = threads[thread_index];
+		const Winner winner = PlayTournamentGame(options, decks.get( ), game, thread);
+		thread.m_results.AddResult((AIType)((game % GamesPerRound) / (uint32_t)AIType::MAX), (AIType)(game % (uint32_t)AIType::MAX), winner);
+	});
+
+	// Destroying the writers flushes what they have left
+	for (unsigned i = 0; i < pool.NumThreads( ); ++i)
+	{
+		out_results.AddResults(threads[i].m_results);
+		threads[i].m_log_writer.reset( );
+	}
 }
 
-void AITournament( uint32_t num_rounds, PlayResults& results )
+void AITournamentSPRT( uint32_t max_games, const SPRT& test, PlayResults& out_results, SPRTResults& out_tests, const TournamentOptions& options )
 {
-	std::mt19937 r(GlobalRandomDevice( ));
-	Card deck[30];
-	for (uint32_t i = 0; i < num_rounds; ++i)
+	// A pairing's games are counted in the order they were handed out, whichever finish first, so where it
+	// stops doesn't depend on the threads. Games still being played when it stops aren't counted.
+	struct Pairing
+	{
+		uint32_t m_next_game; // Handed out
+		uint32_t m_num_counted;
+		PairingTest m_test;
+		std::vector<Winner> m_winners;
+	};
+	Pairing pairings[GamesPerRound];
+	for (Pairing& pairing : pairings)
+	{
+		pairing.m_next_game = 0;
+		pairing.m_num_counted = 0;
+		pairing.m_winners.assign(max_games, Winner::Undetermined);
+	}
+
+	const std::unique_ptr<Card[][30]> decks = DealDecks(options, max_games);
+	ThreadPool& pool = ThreadPool::Shared( );
+	std::unique_ptr<TournamentThread[]> threads(new TournamentThread[pool.NumThreads( )]);
+	std::mutex mutex;
+
+	// One job per thread, each playing games until no pairing is left open
+	pool.ParallelFor(pool.NumThreads( ), options.m_max_threads, [&](unsigned, unsigned thread_index)
 	{
-		if ((i % 10) == 0)
+		for (;;)
 		{
-			std::uniform_int_distribution<uint32_t> deck_dist(0, DeckPossibleCards.size( ) - 1);
-			for (Card& c : deck)
+			// The open pairing with the fewest games handed out, so threads freed by pairings that have stopped
+			// spread over the ones still going
+			uint32_t index = GamesPerRound;
+			uint32_t game;
 			{
-				c = DeckPossibleCards[deck_dist(r)];
+				std::lock_guard<std::mutex> lock(mutex);
+				for (uint32_t i = 0; i < GamesPerRound; ++i)
+				{
+					const Pairing& pairing = pairings[i];
+					if (pairing.m_test.m_result == SPRT::Result::Continue && pairing.m_next_game < max_games
+						&& (index == GamesPerRound || pairing.m_next_game < pairings[index].m_next_game))
+					{
+						index = i;
+					}
+				}
+				if (index == GamesPerRound)
+					return;
+
+				game = pairings[index].m_next_game++;
 			}
-		}
 
-		for (AIType player_one = AIType::Random; player_one != AIType::MAX; player_one = (AIType)(1 + (int)player_one))
-		{
-			for (AIType player_two = AIType::Random; player_two != AIType::MAX; player_two = (AIType)(1 + (int)player_two))
+			// The same game AITournament plays for this pairing in this round
+			const Winner winner = PlayTournamentGame(options, decks.get( ), game * GamesPerRound + index, threads[thread_index]);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			Pairing& pairing = pairings[index];
+			pairing.m_winners[game] = winner;
+			PairingTest& result = pairing.m_test;
+			while (result.m_result == SPRT::Result::Continue && pairing.m_num_counted < pairing.m_next_game && pairing.m_winners[pairing.m_num_counted] != Winner::Undetermined)
 			{
-				Winner winner = PlayGame(r, deck, player_one, player_two);
-				results.AddResult(player_one, player_two, winner);
+				switch (pairing.m_winners[pairing.m_num_counted++])
+				{
+				case Winner::PlayerOne: result.m_player_one_wins++; break;
+				case Winner::PlayerTwo: result.m_player_two_wins++; break;
+				default: result.m_draws++; break;
+				}
+				result.m_llr = test.LogLikelihoodRatio(result.m_player_one_wins, result.m_draws, result.m_player_two_wins);
+				result.m_result = test.Test(result.m_player_one_wins, result.m_draws, result.m_player_two_wins);
 			}
 		}
+	});
+
+	for (uint32_t i = 0; i < GamesPerRound; ++i)
+	{
+		const PairingTest& result = pairings[i].m_test;
+		const AIType player_one = (AIType)(i / (uint32_t)AIType::MAX);
+		const AIType player_two = (AIType)(i % (uint32_t)AIType::MAX);
+		const uint32_t index = (uint32_t)player_two * (uint32_t)AIType::MAX + (uint32_t)player_one;
+
+		out_tests.m_tests[index] = result;
+		PairingResults& counts = out_results.m_results[index];
+		counts.m_player_one_wins += result.m_player_one_wins;
+		counts.m_player_two_wins += result.m_player_two_wins;
+		counts.m_draws += result.m_draws;
+	}
+
+	for (unsigned i = 0; i < pool.NumThreads( ); ++i)
+	{
+		threads[i].m_log_writer.reset( );
 	}
 }
 
-void AITournamentMT( uint32_t total_rounds, PlayResults& out_results )
+void AITournamentRated( uint32_t num_games, PlayResults& out_results, Ratings& ratings, const TournamentOptions& options )
 {
-	auto job = []( uint32_t rounds ) {
-		PlayResults res;
-		AITournament(rounds, res);
-		return res;
-	};
+	// Enough for all the games to go to one pairing, which they never would
+	const std::unique_ptr<Card[][30]> decks = DealDecks(options, num_games);
+	ThreadPool& pool = ThreadPool::Shared( );
+	std::unique_ptr<TournamentThread[]> threads(new TournamentThread[pool.NumThreads( )]);
 
-	unsigned num_jobs = std::thread::hardware_concurrency( );
-	std::vector< std::future<PlayResults> > job_results;
-	for (unsigned i = 0; i < num_jobs; ++i)
+	uint32_t games_played[GamesPerRound] = {};
+	std::vector<uint32_t> batch; // Tournament game numbers
+	std::vector<Winner> winners;
+	const uint32_t num_ais = (uint32_t)AIType::MAX;
+
+	for (uint32_t first = 0; first < num_games; first += RatedBatchGames)
 	{
-		uint32_t rounds = total_rounds / num_jobs;
-		if (rounds > (total_rounds - i * rounds))
+		// Plan the batch on a copy, which takes each planned game into account when choosing the next
+		Ratings plan(ratings);
+		batch.clear( );
+		for (uint32_t i = first; i < std::min(first + RatedBatchGames, num_games); ++i)
 		{
-			rounds = total_rounds - i * rounds;
+			uint32_t best_a = 0, best_b = 1;
+			double best_reduction = -1.0;
+			for (uint32_t a = 0; a < num_ais; ++a)
+			{
+				for (uint32_t b = a + 1; b < num_ais; ++b)
+				{
+					const double reduction = plan.VarianceReduction(a, b);
+					if (reduction > best_reduction)
+					{
+						best_a = a;
+						best_b = b;
+						best_reduction = reduction;
+					}
+				}
+			}
+			plan.AddPlannedGame(best_a, best_b);
+
+			// The ratings don't know who moved first, so the two take turns at it
+			uint32_t pairing = best_a * num_ais + best_b;
+			const uint32_t swapped = best_b * num_ais + best_a;
+			if (games_played[swapped] < games_played[pairing])
+			{
+				pairing = swapped;
+			}
+			batch.push_back(games_played[pairing]++ * GamesPerRound + pairing);
 		}
 
-		job_results.emplace_back(std::async(job, rounds));
+		winners.assign(batch.size( ), Winner::Undetermined);
+		pool.ParallelFor((unsigned)batch.size( ), options.m_max_threads, [&](unsigned job, unsigned thread_index)
+		{
+			winners[job] = PlayTournamentGame(options, decks.get( ), batch[job], threads[thread_index]);
+		});
+
+		for (size_t i = 0; i < batch.size( ); ++i)
+		{
+			const uint32_t player_one = (batch[i] % GamesPerRound) / num_ais;
+			const uint32_t player_two = batch[i] % num_ais;
+			ratings.AddResult(player_one, player_two, winners[i]);
+			out_results.AddResult((AIType)player_one, (AIType)player_two, winners[i]);
+		}
+		ratings.Fit( );
 	}
 
-	for (auto& f : job_results)
+	for (unsigned i = 0; i < pool.NumThreads( ); ++i)
 	{
-		out_results.AddResults(f.get( ));
+		threads[i].m_log_writer.reset( );
 	}
 }
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include <cstdint>
 
 #include "GameState.h"
+#include "Clock.h"
+#include "SPRT.h"
 
 enum class AIType
 {
@@ -33,8 +35,53 @@ struct PlayResults
 	void Print( ) const;
 };
 
-void AITournament( uint32_t rounds, PlayResults& results );
-void AITournamentMT( uint32_t rounds, PlayResults& results );
+// The SPRT of one pairing, over the games it counted
+struct PairingTest
+{
+	uint32_t m_player_one_wins;
+	uint32_t m_player_two_wins;
+	uint32_t m_draws;
+	double m_llr;
+	SPRT::Result m_result; // Continue if it ran out of games
+
+	PairingTest( );
+};
+
+struct SPRTResults
+{
+	PairingTest m_tests[(uint32_t)AIType::MAX * (uint32_t)AIType::MAX]; // Indexed like PlayResults
+
+	void Print(const SPRT& test) const;
+};
+
+class GameLog;
+class Ratings;
+
+struct TournamentOptions
+{
+	HighResClock::duration m_move_time; // Each AI searches this long for every move, or for m_iterations if it's zero
+	unsigned m_iterations; // Of CheatingMCTS and SO-IS, and of all the determinizations of DetMCTS together
+	uint64_t m_seed; // Every deck, game and search of the tournament follows from this
+	unsigned m_max_threads; // Of the shared pool
+	GameLog* m_log; // Every game is appended to this, if there is one
+
+	TournamentOptions( );
+};
+
+// With an iteration budget, a tournament plays the same games for the same seed however many threads it has
+void AITournament( uint32_t rounds, PlayResults& results, const TournamentOptions& options = TournamentOptions( ) );
+void AITournamentMT( uint32_t rounds, PlayResults& results, const TournamentOptions& options = TournamentOptions( ) );
+
+// Plays each pairing until its SPRT accepts a hypothesis or it has played max_games, moving threads to the pairings
+// still open as others stop. A pairing's nth game is the one AITournament plays for it in round n, and where it
+// stops doesn't depend on the number of threads.
+void AITournamentSPRT( uint32_t max_games, const SPRT& test, PlayResults& results, SPRTResults& tests, const TournamentOptions& options = TournamentOptions( ) );
+
+// Plays num_games games to rate the AIs, which ratings must have a player for each of. Games are chosen a batch at
+// a time, each where it's expected to shrink the errors of the ratings most, so pairings far apart in strength
+// stop being played once their gap is known. Mirror matches say nothing about the ratings and aren't played.
+// A pairing's nth game is the one AITournament plays for it in round n, and the choices don't depend on the threads.
+void AITournamentRated( uint32_t num_games, PlayResults& results, Ratings& ratings, const TournamentOptions& options = TournamentOptions( ) );
 
 
 typedef Move(*PlayFunction)(const GameState&);
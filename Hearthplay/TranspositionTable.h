@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+// Fixed size table from state hashes to search nodes, so searches can share one node between
+// move orders that reach the same state. The table never grows past the size it was given:
+// entries are kept in buckets of one cache line, and when a bucket is full the entry whose node
+// has the fewest visits is replaced. Replaced nodes stay in their search, they just can't be found.
+// NodeType needs an m_visits count.
+template<typename NodeType>
+class TranspositionTable
+{
+public:
+	static const size_t DefaultBytes = 1 << 20;
+
+	TranspositionTable(size_t max_bytes = DefaultBytes)
+	{
+		size_t num_buckets = 1;
+		while (num_buckets * 2 * sizeof(Bucket) <= max_bytes)
+		{
+			num_buckets *= 2;
+		}
+
+		// new only guarantees the alignment of the largest standard type, so the buckets are lined up with
+		// cache lines by hand
+		m_storage.reset(new uint8_t[num_buckets * sizeof(Bucket) + CacheLineSize - 1]);
+		m_buckets = reinterpret_cast<Bucket*>(((uintptr_t)m_storage.get( ) + CacheLineSize - 1) & ~(uintptr_t)(CacheLineSize - 1));
+		m_mask = num_buckets - 1;
+		Clear( );
+	}
+
+	TranspositionTable(const TranspositionTable& other) = delete;
+	TranspositionTable& operator=(const TranspositionTable& other) = delete;
+
+	inline void Clear( )
+	{
+		memset(m_buckets, 0, NumBytes( ));
+	}
+
+	inline NodeType* Find(uint64_t hash) const
+	{
+		const Bucket& bucket = m_buckets[hash & m_mask];
+		for (const Entry& entry : bucket.m_entries)
+		{
+			if (entry.m_node && entry.m_hash == hash)
+			{
+				return entry.m_node;
+			}
+		}
+		return nullptr;
+	}
+
+	inline void Insert(uint64_t hash, NodeType* node)
+	{
+		Bucket& bucket = m_buckets[hash & m_mask];
+		Entry* replace = &bucket.m_entries[0];
+		for (Entry& entry : bucket.m_entries)
+		{
+			if (!entry.m_node || entry.m_hash == hash)
+			{
+				replace = &entry;
+				break;
+			}
+
+			if (entry.m_node->m_visits < replace->m_node->m_visits)
+			{
+				replace = &entry;
+			}
+		}
+
+		replace->m_hash = hash;
+		replace->m_node = node;
+	}
+
+	inline size_t NumBytes( ) const
+	{
+		return (m_mask + 1) * sizeof(Bucket);
+	}
+
+private:
+	static const size_t CacheLineSize = 64;
+
+	struct Entry
+	{
+		uint64_t	m_hash;
+		NodeType*	m_node;
+	};
+
+	struct ALIGN_TO(64) Bucket
+	{
+		Entry m_entries[CacheLineSize / sizeof(Entry)];
+	};
+
+	std::unique_ptr<uint8_t[]>	m_storage;
+	Bucket*						m_buckets;
+	size_t						m_mask;
+};
@@ -0,0 +1,148 @@
+#include "UCT.h"
+
+#if defined(__AVX2__)
+#define UCT_AVX2 1
+#include <immintrin.h>
+#else
+#define UCT_AVX2 0
+#endif
+
+struct UCTTables
+{
+	float m_inv_sqrt[UCTTableSize];
+	float m_sqrt_log[UCTTableSize];
+
+	UCTTables( )
+	{
+		// Entry 0 is never used, as every child has been visited and available at least once
+		m_inv_sqrt[0] = 0.0f;
+		m_sqrt_log[0] = 0.0f;
+		for (uint32_t n = 1; n < UCTTableSize; ++n)
+		{
+			m_inv_sqrt[n] = 1.0f / sqrtf((float)n);
+			m_sqrt_log[n] = sqrtf(logf((float)n));
+		}
+	}
+};
+
+static const UCTTables Tables;
+const float* const UCTInvSqrtTable = Tables.m_inv_sqrt;
+const float* const UCTSqrtLogTable = Tables.m_sqrt_log;
+
+static inline float Score(uint32_t wins, uint32_t visits, float sqrt_log)
+{
+	const float inv_sqrt = UCTInvSqrt(visits);
+	return inv_sqrt * ((float)wins * inv_sqrt + sqrt_log);
+}
+
+#if UCT_AVX2
+// Whether any of eight counts is too big for the tables, in which case the scalar loop scores the rest
+static inline bool AnyPastTables(__m256i counts)
+{
+	const __m256i past = _mm256_cmpgt_epi32(counts, _mm256_set1_epi32((int)UCTTableSize - 1));
+	return !_mm256_testz_si256(past, past);
+}
+
+static inline __m256 Score(__m256i wins, __m256i visits, __m256 sqrt_log)
+{
+	const __m256 inv_sqrt = _mm256_i32gather_ps(UCTInvSqrtTable, visits, 4);
+	return _mm256_mul_ps(inv_sqrt, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(wins), inv_sqrt), sqrt_log));
+}
+#endif
+
+void UCTScores(const uint32_t* wins, const uint32_t* visits, unsigned num, uint32_t parent_visits, float* out_scores)
+{
+	const float sqrt_log = UCTSqrtLog(parent_visits);
+	unsigned i = 0;
+#if UCT_AVX2
+	const __m256 sqrt_log8 = _mm256_set1_ps(sqrt_log);
+	for (; i + 8 <= num; i += 8)
+	{
+		const __m256i visits8 = _mm256_loadu_si256((const __m256i*)(visits + i));
+		if (AnyPastTables(visits8))
+			break;
+
+		const __m256i wins8 = _mm256_loadu_si256((const __m256i*)(wins + i));
+		_mm256_storeu_ps(out_scores + i, Score(wins8, visits8, sqrt_log8));
+	}
+#endif
+	for (; i < num; ++i)
+	{
+		out_scores[i] = Score(wins[i], visits[i], sqrt_log);
+	}
+}
+
+void UCTScores(const uint32_t* wins, const uint32_t* visits, const uint32_t* availability, unsigned num, float* out_scores)
+{
+	unsigned i = 0;
+#if UCT_AVX2
+	for (; i + 8 <= num; i += 8)
+	{
+		const __m256i visits8 = _mm256_loadu_si256((const __m256i*)(visits + i));
+		const __m256i availability8 = _mm256_loadu_si256((const __m256i*)(availability + i));
+		if (AnyPastTables(_mm256_or_si256(visits8, availability8)))
+			break;
+
+		const __m256i wins8 = _mm256_loadu_si256((const __m256i*)(wins + i));
+		const __m256 sqrt_log8 = _mm256_i32gather_ps(UCTSqrtLogTable, availability8, 4);
+		_mm256_storeu_ps(out_scores + i, Score(wins8, visits8, sqrt_log8));
+	}
+#endif
+	for (; i < num; ++i)
+	{
+		out_scores[i] = Score(wins[i], visits[i], UCTSqrtLog(availability[i]));
+	}
+}
+
+unsigned BestScore(const float* scores, unsigned num)
+{
+	unsigned i = 0;
+#if UCT_AVX2
+	if (num >= 8)
+	{
+		// Find the highest score, then the first child with it
+		float best_score = scores[0];
+		__m256 best8 = _mm256_loadu_ps(scores);
+		for (i = 8; i + 8 <= num; i += 8)
+		{
+			best8 = _mm256_max_ps(best8, _mm256_loadu_ps(scores + i));
+		}
+		for (; i < num; ++i)
+		{
+			best_score = scores[i] > best_score ? scores[i] : best_score;
+		}
+
+		float lanes[8];
+		_mm256_storeu_ps(lanes, best8);
+		for (float lane : lanes)
+		{
+			best_score = lane > best_score ? lane : best_score;
+		}
+
+		const __m256 best_score8 = _mm256_set1_ps(best_score);
+		for (i = 0; i + 8 <= num; i += 8)
+		{
+			const int equal = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(scores + i), best_score8, _CMP_EQ_OQ));
+			if (equal)
+			{
+				unsigned lane = 0;
+				while (!(equal & (1 << lane)))
+				{
+					++lane;
+				}
+				return i + lane;
+			}
+		}
+		for (; scores[i] != best_score; ++i)
+		{
+		}
+		return i;
+	}
+#endif
+	unsigned best = 0;
+	for (i = 1; i < num; ++i)
+	{
+		best = scores[i] > scores[best] ? i : best;
+	}
+	return best;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// UCB1 selection over a node's children, which the searches keep as parallel arrays of statistics.
+// Scores are worked out for every child in one pass, eight at a time with AVX2 when the build targets it,
+// and the best is picked out afterwards.
+//
+// Scores are inv_sqrt(visits) * (wins * inv_sqrt(visits) + sqrt(log(n))), which is the usual
+// wins / visits + sqrt(log(n) / visits) rearranged so small counts can be looked up in tables instead of
+// calling log, sqrt and dividing for every child. The two can differ in the last bit or so, so children
+// whose scores are that close may be picked in either order, and the first of equal scores is chosen.
+
+static const uint32_t UCTTableSize = 4096;
+
+extern const float* const UCTInvSqrtTable; // 1 / sqrt(n)
+extern const float* const UCTSqrtLogTable; // sqrt(log(n))
+
+inline float UCTInvSqrt(uint32_t n)
+{
+	return n < UCTTableSize ? UCTInvSqrtTable[n] : 1.0f / sqrtf((float)n);
+}
+
+inline float UCTSqrtLog(uint32_t n)
+{
+	return n < UCTTableSize ? UCTSqrtLogTable[n] : sqrtf(logf((float)n));
+}
+
+// Score of each child from its wins and visits and its parent's visits.
+// Every child must have been visited.
+void UCTScores(const uint32_t* wins, const uint32_t* visits, unsigned num, uint32_t parent_visits, float* out_scores);
+
+// As above, but each child uses how often it was available instead of its parent's visits
+void UCTScores(const uint32_t* wins, const uint32_t* visits, const uint32_t* availability, unsigned num, float* out_scores);
+
+// Index of the highest score, the first one on ties. num must not be 0.
+unsigned BestScore(const float* scores, unsigned num);
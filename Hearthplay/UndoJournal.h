@@ -0,0 +1,100 @@
+#pragma once
+
+#include "FixedVector.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+// Records the bytes a move is about to overwrite, so a state can be walked forwards and rolled back in place.
+// Each entry is stored as [old bytes][address][size] so the journal can be walked backwards from its end.
+class UndoJournal
+{
+public:
+	typedef size_t Mark;
+
+	UndoJournal( )
+		: m_size(0)
+		, m_capacity(0)
+	{
+	}
+
+	inline Mark GetMark( ) const
+	{
+		return m_size;
+	}
+
+	inline void Save(void* ptr, size_t size)
+	{
+		size_t entry_size = size + sizeof(void*) + sizeof(size_t);
+		if (m_size + entry_size > m_capacity)
+		{
+			Grow(m_size + entry_size);
+		}
+
+		uint8_t* dest = &m_bytes[m_size];
+		m_size += entry_size;
+		memcpy(dest, ptr, size);
+		memcpy(dest + size, &ptr, sizeof(void*));
+		memcpy(dest + size + sizeof(void*), &size, sizeof(size_t));
+	}
+
+	template<typename T>
+	inline void Save(T& value)
+	{
+		Save(&value, sizeof(T));
+	}
+
+	// Only the elements in use and the size need saving
+	template<typename T, unsigned Capacity, typename SizeType>
+	inline void Save(FixedVector<T, Capacity, SizeType>& vec)
+	{
+		vec.ForEachUsedRange([this](void* ptr, size_t size) { Save(ptr, size); });
+	}
+
+	// Restore everything saved since mark, newest first
+	inline void RollBack(Mark mark)
+	{
+		size_t end = m_size;
+		while (end > mark)
+		{
+			void* ptr;
+			size_t size;
+			memcpy(&size, &m_bytes[end - sizeof(size_t)], sizeof(size_t));
+			memcpy(&ptr, &m_bytes[end - sizeof(size_t) - sizeof(void*)], sizeof(void*));
+			end -= size + sizeof(void*) + sizeof(size_t);
+			memcpy(ptr, &m_bytes[end], size);
+		}
+		m_size = mark;
+	}
+
+	inline size_t NumBytes( ) const
+	{
+		return m_size;
+	}
+
+private:
+	void Grow(size_t min_capacity)
+	{
+		size_t capacity = m_capacity ? m_capacity : 16 * 1024;
+		while (capacity < min_capacity)
+		{
+			capacity *= 2;
+		}
+
+		std::unique_ptr<uint8_t[]> bytes(new uint8_t[capacity]);
+		if (m_size)
+		{
+			memcpy(bytes.get( ), m_bytes.get( ), m_size);
+		}
+		m_bytes = std::move(bytes);
+		m_capacity = capacity;
+	}
+
+	// Capacity is kept when rolling back, so a warmed up journal doesn't allocate
+	std::unique_ptr<uint8_t[]>	m_bytes;
+	size_t						m_size;
+	size_t						m_capacity;
+};